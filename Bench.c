@@ -0,0 +1,199 @@
+#include "Bench.h"
+#include "EasyCon_Math.h"
+
+#ifdef EASYCON_BENCH
+
+// operations per measurement, keep total below 65536 cycles
+#define BENCH_OPS 16
+
+// report load of last full second
+static uint32_t report_cycles = 0, last_report_cycles = 0;
+static uint16_t report_count = 0, last_report_count = 0;
+static uint16_t load_ms = 0;
+
+// serial parser cost since last query
+static uint32_t serial_bytes = 0, serial_cycles = 0;
+static uint16_t serial_max = 0;
+
+// interpreter cost since last query
+static uint32_t vm_instructions = 0, vm_cycles = 0;
+static uint32_t vm_context_cycles = 0;
+
+// volatile operands keep the compiler from folding the loops
+static volatile int16_t bench_a = -12345;
+static volatile int16_t bench_b;
+static volatile int16_t bench_r;
+
+// send average cycles per operation, low byte first
+static void bench_send(uint16_t cycles)
+{
+    cycles /= BENCH_OPS;
+    EasyCon_serial_send(cycles);
+    EasyCon_serial_send(cycles >> 8);
+}
+
+// Account one pass of report task, called from main loop.
+void Bench_Report(uint16_t cycles, bool sent)
+{
+    report_cycles += cycles;
+    if (sent)
+        report_count++;
+}
+
+// Roll load window every second, called from 1 ms timer.
+void Bench_Tick(void)
+{
+    if (++load_ms < 1000)
+        return;
+    load_ms = 0;
+    last_report_cycles = report_cycles;
+    last_report_count = report_count;
+    report_cycles = 0;
+    report_count = 0;
+}
+
+/* Reply report load of last second: cycles spent in report task (4 bytes), reports sent (2 bytes).
+ * Compare across report policies to see the MCU time saved while idle.
+ */
+static void Bench_Load(void)
+{
+    for (uint8_t i = 0; i < 4; i++)
+        EasyCon_serial_send(last_report_cycles >> (i << 3));
+    EasyCon_serial_send(last_report_count);
+    EasyCon_serial_send(last_report_count >> 8);
+}
+
+// Account one received byte, called from serial ISR.
+// Bytes that block longer than 4 ms (EEPROM writes, replies) wrap the counter.
+void Bench_Serial(uint16_t cycles)
+{
+    serial_bytes++;
+    serial_cycles += cycles;
+    if (cycles > serial_max)
+        serial_max = cycles;
+}
+
+/* Reply serial parser cost since last query: bytes (4 bytes), cycles (4 bytes), max cycles of a byte (2 bytes).
+ * Cycles per byte bound the baud rate the parser keeps up with.
+ */
+static void Bench_Serial_Stats(void)
+{
+    for (uint8_t i = 0; i < 4; i++)
+        EasyCon_serial_send(serial_bytes >> (i << 3));
+    for (uint8_t i = 0; i < 4; i++)
+        EasyCon_serial_send(serial_cycles >> (i << 3));
+    EasyCon_serial_send(serial_max);
+    EasyCon_serial_send(serial_max >> 8);
+    serial_bytes = 0;
+    serial_cycles = 0;
+    serial_max = 0;
+}
+
+// Account one script instruction, from fetch to dispatch done, called from script task.
+void Bench_Instruction(uint16_t cycles)
+{
+    vm_instructions++;
+    vm_cycles += cycles;
+}
+
+// Account loading or saving interpreter registers, called from script task.
+void Bench_Context(uint16_t cycles)
+{
+    vm_context_cycles += cycles;
+}
+
+/* Reply interpreter cost since last query: instructions (4 bytes), cycles (4 bytes),
+ * cycles loading and saving interpreter registers (4 bytes).
+ * Run the same script before and after an interpreter change to compare cycles per instruction,
+ * counting both cycle sums.
+ */
+static void Bench_VM(void)
+{
+    for (uint8_t i = 0; i < 4; i++)
+        EasyCon_serial_send(vm_instructions >> (i << 3));
+    for (uint8_t i = 0; i < 4; i++)
+        EasyCon_serial_send(vm_cycles >> (i << 3));
+    for (uint8_t i = 0; i < 4; i++)
+        EasyCon_serial_send(vm_context_cycles >> (i << 3));
+    vm_instructions = 0;
+    vm_cycles = 0;
+    vm_context_cycles = 0;
+}
+
+// measure all kernels with the given divisor
+static void Bench_Kernel_Set(int16_t divisor)
+{
+    uint16_t state = 1;
+    uint16_t t;
+
+    bench_b = divisor;
+    t = Bench_Cycles();
+    for (uint8_t i = 0; i < BENCH_OPS; i++)
+        bench_r = rand() % bench_b;
+    bench_send(Bench_Cycles() - t);
+
+    t = Bench_Cycles();
+    for (uint8_t i = 0; i < BENCH_OPS; i++)
+        bench_r = random_mod(&state, bench_b);
+    bench_send(Bench_Cycles() - t);
+
+    t = Bench_Cycles();
+    for (uint8_t i = 0; i < BENCH_OPS; i++)
+        bench_r = bench_a / bench_b;
+    bench_send(Bench_Cycles() - t);
+
+    t = Bench_Cycles();
+    for (uint8_t i = 0; i < BENCH_OPS; i++)
+    {
+        int16_t b = bench_b;
+        bench_r = is_pow2(b) ? div_pow2(bench_a, b) : bench_a / b;
+    }
+    bench_send(Bench_Cycles() - t);
+
+    t = Bench_Cycles();
+    for (uint8_t i = 0; i < BENCH_OPS; i++)
+        bench_r = bench_a % bench_b;
+    bench_send(Bench_Cycles() - t);
+
+    t = Bench_Cycles();
+    for (uint8_t i = 0; i < BENCH_OPS; i++)
+    {
+        int16_t b = bench_b;
+        bench_r = is_pow2(b) ? mod_pow2(bench_a, b) : bench_a % b;
+    }
+    bench_send(Bench_Cycles() - t);
+}
+
+/* Compare VM math kernels with the generic library code.
+ * Replies cycles per operation for rand()%n, random_mod, /, div_pow2, %, mod_pow2,
+ * first with divisor 64 (power of two fast path), then with 37 (generic fallback).
+ * Runs inside serial ISR, so nothing else interrupts the measurement.
+ */
+static void Bench_Kernels(void)
+{
+    Bench_Kernel_Set(64);
+    Bench_Kernel_Set(37);
+}
+
+void Bench_Run(uint8_t which)
+{
+    switch (which)
+    {
+    case BENCH_KERNELS:
+        Bench_Kernels();
+        break;
+    case BENCH_LOAD:
+        Bench_Load();
+        break;
+    case BENCH_SERIAL:
+        Bench_Serial_Stats();
+        break;
+    case BENCH_VM:
+        Bench_VM();
+        break;
+    default:
+        EasyCon_serial_send(REPLY_ERROR);
+        break;
+    }
+}
+#endif
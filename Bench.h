@@ -0,0 +1,23 @@
+#pragma once
+
+#include <avr/io.h>
+#include <stdlib.h>
+
+#include "EasyCon.h"
+#include "EasyCon_API.h"
+
+// free running timer1 at F_CPU, wraps after 65536 cycles
+#define Bench_Cycles() TCNT1
+
+// benchmarks selected by CMD_BENCH argument
+#define BENCH_KERNELS 0
+#define BENCH_LOAD 1
+#define BENCH_SERIAL 2
+#define BENCH_VM 3
+
+void Bench_Run(uint8_t which);
+void Bench_Tick(void);
+void Bench_Report(uint16_t cycles, bool sent);
+void Bench_Serial(uint16_t cycles);
+void Bench_Instruction(uint16_t cycles);
+void Bench_Context(uint16_t cycles);
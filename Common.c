@@ -2,6 +2,14 @@
 
 volatile uint8_t led_ms = 0; // transmission LED countdown
 
+// serial transmit queue, drained by UDRE interrupt
+#if (SERIAL_TX_SIZE & (SERIAL_TX_SIZE - 1)) != 0 || SERIAL_TX_SIZE > 256
+#error "SERIAL_TX_SIZE must be a power of two up to 256"
+#endif
+static volatile uint8_t tx_buffer[SERIAL_TX_SIZE];
+static volatile uint8_t tx_head = 0; // next byte to write
+static volatile uint8_t tx_tail = 0; // next byte to send
+
 inline void disable_rx_isr(void)
 {
     UCSR1B &= ~_BV(RXCIE1);
@@ -32,6 +40,68 @@ void BlinkLEDTick(void)
     }
 }
 
+// Queue a byte for sending, waits only while the queue is full.
+void Serial_QueueByte(const char DataByte)
+{
+    uint_reg_t sreg = GetGlobalInterruptMask();
+    uint8_t next;
+    for (;;)
+    {
+        GlobalInterruptDisable();
+        next = (tx_head + 1) & (SERIAL_TX_SIZE - 1);
+        if (next != tx_tail)
+            break;
+        if (sreg & _BV(SREG_I))
+        {
+            // queue full, wait with interrupts on while UDRE interrupt drains it
+            SetGlobalInterruptMask(sreg);
+            while (next == tx_tail);
+        }
+        else if (UCSR1A & _BV(UDRE1))
+        {
+            // queue full and called with interrupts off (from an ISR), send one byte by hand
+            UDR1 = tx_buffer[tx_tail];
+            tx_tail = (tx_tail + 1) & (SERIAL_TX_SIZE - 1);
+        }
+    }
+    tx_buffer[tx_head] = DataByte;
+    tx_head = next;
+    UCSR1B |= _BV(UDRIE1);
+    SetGlobalInterruptMask(sreg);
+}
+
+bool Serial_QueueFrame(const uint8_t *Data, uint8_t Length)
+{
+    uint_reg_t sreg = GetGlobalInterruptMask();
+    GlobalInterruptDisable();
+    if (((tx_tail - tx_head - 1) & (SERIAL_TX_SIZE - 1)) < Length)
+    {
+        SetGlobalInterruptMask(sreg);
+        return false;
+    }
+    while (Length--)
+    {
+        tx_buffer[tx_head] = *Data++;
+        tx_head = (tx_head + 1) & (SERIAL_TX_SIZE - 1);
+    }
+    UCSR1B |= _BV(UDRIE1);
+    SetGlobalInterruptMask(sreg);
+    return true;
+}
+
+// Send next queued byte, called when UART data register is empty.
+void Serial_TXTask(void)
+{
+    if (tx_head == tx_tail)
+    {
+        // nothing left
+        UCSR1B &= ~_BV(UDRIE1);
+        return;
+    }
+    UDR1 = tx_buffer[tx_tail];
+    tx_tail = (tx_tail + 1) & (SERIAL_TX_SIZE - 1);
+}
+
 void Serial_Send(const char DataByte)
 {
     Serial_SendByte(DataByte);
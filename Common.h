@@ -26,4 +26,7 @@ extern volatile uint8_t led_ms;
 void CommonInit(void);
 void BlinkLED(void);
 void BlinkLEDTick(void);
-void Serial_Send(const char DataByte);
\ No newline at end of file
+void Serial_Send(const char DataByte);
+void Serial_QueueByte(const char DataByte);
+bool Serial_QueueFrame(const uint8_t *Data, uint8_t Length);
+void Serial_TXTask(void);
\ No newline at end of file
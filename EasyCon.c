@@ -1,21 +1,63 @@
 #include "EasyCon.h"
 #include "EasyCon_API.h"
+#include "EasyCon_Math.h"
+#include <util/atomic.h>
+#ifdef EASYCON_BENCH
+#include "Bench.h"
+#endif
 
 // global variables
 volatile uint8_t echo_ms = 0; // echo counter
 
 // static variables
-static uint8_t mem[MEM_SIZE] = {0xFF, 0xFF, VERSION}; // preallocated memory for all purposes, as well as static instruction carrier
+static const uint8_t script_image[MEM_SIZE] EASYCON_CONST = {0xFF, 0xFF, VERSION}; // static instruction carrier
+static mem_t mem;                                     // preallocated memory for all purposes
 static size_t serial_buffer_length = 0;               // current length of serial buffer
 static bool serial_command_ready = false;             // CMD_READY acknowledged, ready to receive command byte
 static uint8_t *flash_addr = 0;                       // start location for EEPROM flashing
 static uint16_t flash_index = 0;                      // current buffer index
 static uint16_t flash_count = 0;                      // number of bytes expected for this time
+static volatile uint16_t serial_idle_ms = 0;          // time since last serial byte
+static uint8_t protocol = PROTOCOL_V1;                // serial protocol in use
+static uint8_t frame_state = FRAME_IDLE;              // v2 receiving state
+static uint8_t frame_length = 0;                      // payload length of received frame
+static uint8_t frame_index = 0;                       // payload bytes received
+static uint8_t frame_seq = 0;                         // sequence of received frame, echoed by replies
+static uint8_t frame_cmd = 0;                         // command of received frame
+static uint8_t frame_last = 0;                        // previous byte between frames
+static uint16_t frame_crc = FRAME_CRC_INIT;
+static uint8_t reply_buffer[FRAME_CHUNK];             // v2 reply bytes not sent yet
+static uint8_t reply_length = 0;
+static uint8_t *script_base = 0;                      // EEPROM address of active script image
+static uint16_t script_entry = 2;                     // address of first instruction in image
+static uint8_t script_slot = 0;                       // active slot in directory
+static uint8_t active_image = 0;                      // image of active slot
 static uint8_t *script_addr = 0;                      // address of next instruction
+static volatile uint8_t script_generation = 0;        // bumped on each start, script task drops stale context
 static uint8_t *script_eof = 0;                       // address of EOF
+#if COMPRESSED_SCRIPT
+static bool script_compressed = false;                // active image is compressed
+static uint16_t window_block = BLOCK_NONE;            // block decoded in window
+static uint8_t dict_size = 0;                         // dictionary entries of compressed image
+static uint8_t *dict_base = 0;                        // EEPROM address of dictionary
+#endif
 static uint16_t tail_wait = 0;                        // insert an extra wait before next instruction (used by compressed instruction)
 static uint32_t timer_elapsed = 0;                    // previous execution time
 static bool auto_run = false;
+static uint8_t image_state = IMAGE_UNCHECKED;         // verification result of script image, reset by flashing
+static volatile bool start_request = false;           // start asked for from an interrupt, done in main loop
+static volatile bool select_request = false;          // slot switch asked for from an interrupt, done in main loop
+static uint16_t rand_state = 1;                       // xorshift state, never 0
+static bool seed_drawn = false;                       // seed of this power cycle taken from journal
+static volatile uint16_t boot_ms = 0;                 // time from timer start to first report
+static volatile bool boot_reported = false;
+
+// stick direction presets, clockwise from upper left
+static const uint8_t direction_table[32][2] EASYCON_CONST = {
+    {0, 0}, {32, 0}, {64, 0}, {96, 0}, {128, 0}, {160, 0}, {192, 0}, {224, 0},
+    {255, 0}, {255, 32}, {255, 64}, {255, 96}, {255, 128}, {255, 160}, {255, 192}, {255, 224},
+    {255, 255}, {224, 255}, {192, 255}, {160, 255}, {128, 255}, {96, 255}, {64, 255}, {32, 255},
+    {0, 255}, {0, 224}, {0, 192}, {0, 160}, {0, 128}, {0, 96}, {0, 64}, {0, 32}};
 
 // set led state
 static volatile uint8_t _ledflag = 0;
@@ -24,54 +66,152 @@ static volatile uint8_t _ledflag = 0;
 static volatile uint32_t timer_ms = 0; // script timer
 static volatile uint32_t wait_ms = 0;  // waiting counter
 
+// USB frames
+static volatile uint16_t frame_count = 0;  // SOF counter
+static volatile uint16_t wait_frames = 0;  // waiting counter in frames
+static uint16_t report_frame = 0;          // frame of last report sent
+static uint8_t report_setting = 0;        // see REPORT_SOF and REPORT_POLICY
+static uint8_t report_interval = ECHO_INTERVAL;
+static uint8_t report_idle = ECHO_INTERVAL; // current idle interval of adaptive policy
+static uint8_t echo_times = ECHO_TIMES;     // reports to repeat after a change
+
+// report frames are overlaid on script report while running
+static bool mix_enabled = false;
+
+// macro recorder, encodes report frames into active image while no script runs
+static volatile bool recording = false; // VM memory holds recorded code meanwhile
+static bool record_truncated = false;
+static uint16_t record_length = 0;  // bytes of code recorded
+static uint32_t record_start = 0;   // timer_ms at record start
+static uint32_t record_time = 0;    // ms covered by recorded waits
+static uint16_t record_button = 0;  // state as of recorded code
+static uint8_t record_hat = HAT_CENTER;
+static uint8_t record_stick[2] = {DIRECTION_NONE, DIRECTION_NONE};
+
+// register written by host, applied by script task between instructions
+static volatile uint8_t inject_reg = REGISTER_NONE;
+static volatile int16_t inject_value = 0;
+
+// A/B update
+#if HOT_SWAP
+static uint8_t stage_image = STAGE_NONE;     // image receiving a new script
+static uint8_t stage_buffer[STAGE_BUFFER_SIZE];
+static uint8_t *stage_addr = 0;              // EEPROM address of next byte to write
+static uint8_t stage_index = 0;              // next byte in buffer
+static volatile uint8_t stage_count = 0;     // bytes left to write
+static bool stage_reply = false;             // send FLASHEND when written
+static uint8_t stage_seq = 0;                // sequence of CMD_FLASH frame, for FLASHEND
+static volatile bool swap_pending = false;   // switch to staged image at next instruction boundary
+static void EasyCon_script_swap(void);
+#endif
+
+// ms clock for instruction trace
+#if EXEC_TRACE_LENGTH > 0
+static volatile uint16_t exec_clock = 0;
+#endif
+
+// trace and lap dump, too long to send while receiving, sent in pieces by main loop
+#if REPORT_TRACE_LENGTH > 0 || EXEC_TRACE_LENGTH > 0 || LAP_LOG_LENGTH > 0
+static volatile uint8_t dump_cmd = 0; // CMD_TRACE, CMD_EXECTRACE or CMD_LAPS being sent, 0 for none
+static uint8_t dump_seq = 0;          // sequence of requesting frame
+static uint8_t dump_header[4];        // counts as of request
+static uint16_t dump_index = 0;       // next byte to send
+static uint16_t dump_length = 0;      // bytes in whole dump
+static bool reply_deferred = false;   // command reply is left to main loop
+#endif
+
+// telemetry stream
+#if TELEMETRY
+static volatile uint16_t telemetry_interval = 0; // ms between records, 0 for off
+static volatile uint16_t telemetry_ms = 0;       // countdown to next record
+static uint8_t telemetry_seq = 0;                // gaps show dropped records
+#endif
+
 // some funcs only use in EasyCon
 static void EasyCon_binaryop(uint8_t op, uint8_t reg, int16_t value);
+static uint8_t EasyCon_legacy_mem(uint16_t offset);
+static uint16_t EasyCon_seed_next(void);
+static void EasyCon_report_load(void);
+static uint8_t EasyCon_script_verify(void);
 static void zero_echo(void);
+static bool EasyCon_serial_notify(uint8_t seq, uint8_t cmd, const uint8_t *data, uint8_t length);
+static uint8_t EasyCon_frame_build(uint8_t *frame, uint8_t seq, uint8_t cmd, uint8_t flags, const uint8_t *data, uint8_t length);
+#if STICK_MOTION
+static void EasyCon_motion_start(ins_t ins, uint16_t duration);
+static void EasyCon_motion_tick(void);
+#endif
 
 // Initialize script. Load static script into EEPROM if exists.
 void EasyCon_script_init(void)
 {
-    if (mem[0] != 0xFF || mem[1] != 0xFF)
+    uint8_t b0 = EasyCon_read_const_byte(&script_image[0]);
+    uint8_t b1 = EasyCon_read_const_byte(&script_image[1]);
+    if (b0 != 0xFF || b1 != 0xFF)
     {
         // flash instructions from firmware
-        int len = mem[0] | ((mem[1] & 0b01111111) << 8);
+        int len = b0 | ((b1 & 0b01111111) << 8);
+        // eof of compressed image is logical, its size in the image is not stored
+        if (len & COMPRESSED_FLAG)
+            len = MEM_SIZE;
+        len = Min(len, MEM_SIZE);
         for (int i = 0; i < len; i++)
-            if (EasyCon_read_byte((uint8_t *)i) != mem[i])
-                EasyCon_write_byte((uint8_t *)i, mem[i]);
-    }
-    memset(mem, 0, sizeof(mem));
-
-    // randomize
-    _seed = EasyCon_read_2byte((uint16_t *)SEED_OFFSET) + 1;
-    srand(_seed);
-    EasyCon_write_2byte((uint16_t *)SEED_OFFSET, _seed);
-
-    // calculate direction presets
-    for (int i = 0; i < 16; i++)
-    {
-        // part 1
-        int x = (Min(i, 8)) << 5;
-        int y = (Max(i, 8) - 8) << 5;
-        x = Min(x, 255);
-        y = Min(y, 255);
-        DX(i) = x;
-        DY(i) = y;
-    }
-    for (int i = 16; i < 32; i++)
-    {
-        // part 2
-        int x = (24 - Min(i, 24)) << 5;
-        int y = (32 - Max(i, 24)) << 5;
-        x = Min(x, 255);
-        y = Min(y, 255);
-        DX(i) = x;
-        DY(i) = y;
-    }
-    _report_echo = ECHO_TIMES;
+            if (EasyCon_read_byte((uint8_t *)i) != EasyCon_read_const_byte(&script_image[i]))
+                EasyCon_write_byte((uint8_t *)i, EasyCon_read_const_byte(&script_image[i]));
+    }
+    memset(&mem, 0, sizeof(mem));
+    // random seed is drawn on first Rand, nothing is written at boot
+    _report_echo = echo_times;
     // turn on/off led
     _ledflag = EasyCon_read_byte((uint8_t *)LED_SETTING);
+    EasyCon_report_load();
+    // restore active slot, fall back to slot 0
+    if (!EasyCon_script_select(EasyCon_read_byte((uint8_t *)SLOT_SETTING)))
+        EasyCon_script_select(0);
+}
+
+// Select script slot from directory, remembered across power cycles.
+bool EasyCon_script_select(uint8_t slot)
+{
+    if (slot >= SCRIPT_SLOTS)
+        return false;
+    uint16_t entry = EasyCon_read_2byte((uint16_t *)(SLOT_DIRECTORY + (slot << 1)));
+    if (entry == 0xFFFF)
+    {
+        if (slot != 0)
+            return false;
+        // slot 0 defaults to the whole of image 0
+        entry = 2;
+    }
+    if (SLOT_IMAGE(entry) >= SCRIPT_IMAGES)
+        return false;
+    if (_script_running)
+        EasyCon_script_stop();
+#if HOT_SWAP
+    // staging target may become active
+    stage_image = STAGE_NONE;
+    swap_pending = false;
+#endif
+    active_image = SLOT_IMAGE(entry);
+    script_base = (uint8_t *)IMAGE_BASE(SLOT_IMAGE(entry));
+    script_entry = SLOT_ENTRY(entry);
+    script_slot = slot;
+    image_state = IMAGE_UNCHECKED;
+    if (EasyCon_read_byte((uint8_t *)SLOT_SETTING) != slot)
+        EasyCon_write_byte((uint8_t *)SLOT_SETTING, slot);
     // only if highest bit is 0
-    auto_run = (EasyCon_read_byte((uint8_t *)1) >> 7) == 0;
+    auto_run = (EasyCon_read_byte(script_base + 1) >> 7) == 0;
+    return true;
+}
+
+// Select the next slot that holds a script.
+void EasyCon_script_select_next(void)
+{
+    for (uint8_t i = 1; i < SCRIPT_SLOTS; i++)
+    {
+        uint8_t slot = (script_slot + i) % SCRIPT_SLOTS;
+        if (EasyCon_script_select(slot))
+            break;
+    }
 }
 
 void EasyCon_script_tick(void)
@@ -87,16 +227,269 @@ void EasyCon_tick(void)
     timer_ms++;
     if (echo_ms != 0)
         echo_ms--;
+    if (!boot_reported && boot_ms != 0xFFFF)
+        boot_ms++;
+    if (serial_idle_ms != 0xFFFF)
+        serial_idle_ms++;
+#if TELEMETRY
+    if (telemetry_ms != 0)
+        telemetry_ms--;
+#endif
+#if EXEC_TRACE_LENGTH > 0
+    exec_clock++;
+#endif
     EasyCon_script_tick();
+#if STICK_MOTION
+    if (_script_running)
+        EasyCon_motion_tick();
+#endif
+}
+
+// Called on each USB start of frame.
+void EasyCon_frame(void)
+{
+    frame_count++;
+    if (wait_frames != 0 && (_report_echo == 0 || wait_frames > 1))
+        wait_frames--;
+}
+
+// Read script timer, incremented by timer interrupt.
+static inline uint32_t script_timer_ms(void)
+{
+    uint32_t ms;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ms = timer_ms;
+    }
+    return ms;
+}
+
+#if EXEC_TRACE_LENGTH > 0
+// Append an entry to instruction trace ring.
+static inline void EasyCon_exec_trace(uint16_t word)
+{
+    // clock is advanced by timer interrupt, reports may be traced from the start of frame interrupt
+    uint_reg_t sreg = GetGlobalInterruptMask();
+    GlobalInterruptDisable();
+    uint16_t now = exec_clock;
+    uint16_t dt = now - mem.exec.time;
+    // ring is not moved while it is being sent
+    if (dump_cmd == CMD_EXECTRACE)
+    {
+        SetGlobalInterruptMask(sreg);
+        return;
+    }
+    exec_entry_t *e = &mem.exec.entry[mem.exec.head];
+    e->word = word;
+    e->dt = dt > 0xFF ? 0xFF : dt;
+    mem.exec.time = now;
+    mem.exec.head = (mem.exec.head + 1) & (EXEC_TRACE_LENGTH - 1);
+    if (mem.exec.count != 0xFFFF)
+        mem.exec.count++;
+    SetGlobalInterruptMask(sreg);
+}
+#endif
+
+// Record a sent report if it differs from the last recorded one.
+void EasyCon_report_trace(const uint8_t *report)
+{
+#if EXEC_TRACE_LENGTH > 0
+    if (_script_running && dump_cmd != CMD_EXECTRACE && memcmp(mem.exec.last, report, TRACE_REPORT_SIZE) != 0)
+    {
+        memcpy(mem.exec.last, report, TRACE_REPORT_SIZE);
+        memcpy(mem.exec.report[mem.exec.reports & (EXEC_TRACE_REPORTS - 1)], report, TRACE_REPORT_SIZE);
+        EXEC_TRACE(EXEC_TRACE_REPORT | (mem.exec.reports & ~EXEC_TRACE_REPORT));
+        mem.exec.reports++;
+    }
+#endif
+#if REPORT_TRACE_LENGTH > 0
+    trace_event_t *e;
+    if (!_script_running)
+        return;
+    // compare with last sent report, the last stored one is stale once trace is full
+    if (mem.trace_count != 0 && memcmp(mem.trace_last, report, TRACE_REPORT_SIZE) == 0)
+        return;
+    memcpy(mem.trace_last, report, TRACE_REPORT_SIZE);
+    if (mem.trace_count == REPORT_TRACE_LENGTH)
+    {
+        if (mem.trace_lost != 0xFF)
+            mem.trace_lost++;
+        return;
+    }
+    e = &mem.trace[mem.trace_count++];
+    e->time = script_timer_ms();
+    memcpy(e->report, report, TRACE_REPORT_SIZE);
+#endif
+#if REPORT_TRACE_LENGTH == 0 && EXEC_TRACE_LENGTH == 0
+    (void)report;
+#endif
+}
+
+#if TELEMETRY
+// Store n bytes of value little-endian, return next position.
+static uint8_t *put_le(uint8_t *p, uint32_t value, uint8_t n)
+{
+    while (n--)
+    {
+        *p++ = value;
+        value >>= 8;
+    }
+    return p;
+}
+#endif
+
+// Push a state record when due, dropped if serial is busy.
+void EasyCon_telemetry_task(void)
+{
+#if TELEMETRY
+    uint8_t buf[TELEMETRY_SIZE];
+    uint8_t *p = buf;
+    uint8_t sum = 0;
+    uint8_t report[sizeof(USB_JoystickReport_Input_t)];
+    uint8_t depth;
+    if (telemetry_interval == 0 || telemetry_ms != 0)
+        return;
+    telemetry_ms = telemetry_interval;
+    *p++ = TELEMETRY_SYNC;
+    *p++ = telemetry_seq++;
+    p = put_le(p, (uint16_t)script_addr, 2);
+    p = put_le(p, script_timer_ms(), 4);
+    // VM memory holds recorded code while recording, report zeros
+    depth = recording ? 0 : mem.u.s.vm.ctx.forstackindex;
+    if (depth == 0)
+        p = put_le(p, 0, 4);
+    else if (FOR_I(depth - 1) & 0x80000000)
+        p = put_le(p, REG(FOR_I(depth - 1) & 0xF), 4);
+    else
+        p = put_le(p, FOR_I(depth - 1), 4);
+    for (uint8_t i = 0; i < TELEMETRY_REGISTERS; i++)
+        p = put_le(p, recording ? 0 : REG(i), 2);
+    GetReport(report);
+    memcpy(p, report, 7);
+    p += 7;
+    if (protocol == PROTOCOL_V2)
+    {
+        // framed like other v2 output, frame CRC replaces sync and sum
+        uint8_t frame[TELEMETRY_SIZE + 4];
+        uint8_t n = EasyCon_frame_build(frame, buf[1], CMD_TELEMETRY, 0, buf + 1, TELEMETRY_SIZE - 2);
+        EasyCon_serial_send_frame(frame, n);
+        return;
+    }
+    for (uint8_t i = 0; i < TELEMETRY_SIZE - 1; i++)
+        sum += buf[i];
+    *p = sum;
+    EasyCon_serial_send_frame(buf, TELEMETRY_SIZE);
+#endif
+}
+
+// Load report policy from settings, erased bytes fall back to defaults.
+static void EasyCon_report_load(void)
+{
+    report_setting = EasyCon_read_byte((uint8_t *)REPORT_SETTING);
+    report_interval = EasyCon_read_byte((uint8_t *)REPORT_INTERVAL);
+    echo_times = EasyCon_read_byte((uint8_t *)REPORT_ECHO);
+    if (report_setting == 0xFF)
+        report_setting = 0;
+    if (report_interval == 0xFF)
+        report_interval = ECHO_INTERVAL;
+    if (echo_times == 0xFF || echo_times == 0)
+        echo_times = ECHO_TIMES;
+    report_idle = report_interval;
+}
+
+// Report interval while report is changing.
+static uint8_t EasyCon_report_busy_interval(void)
+{
+    uint8_t policy = REPORT_POLICY(report_setting);
+    return policy == POLICY_MAX || policy == POLICY_ADAPTIVE ? 0 : report_interval;
+}
+
+// Whether report is changing, a running stick motion counts as change.
+static bool EasyCon_report_changing(void)
+{
+#if STICK_MOTION
+    if (_script_running && (MOTION(0).mode != MOTION_NONE || MOTION(1).mode != MOTION_NONE))
+        return true;
+#endif
+    return _report_echo > 0;
+}
+
+// Read SOF counter, incremented by USB interrupt.
+static inline uint16_t report_frame_count(void)
+{
+    uint16_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        count = frame_count;
+    }
+    return count;
+}
+
+// Whether a report should be sent now.
+bool EasyCon_report_due(void)
+{
+    if ((report_setting & REPORT_SOF) && report_frame_count() == report_frame)
+        return false;
+    // a change cuts a long idle interval short
+    return echo_ms == 0 || (EasyCon_report_changing() && echo_ms > EasyCon_report_busy_interval());
+}
+
+// Read waiting time left, decremented by timer interrupt.
+static inline uint32_t script_wait_ms(void)
+{
+    uint32_t ms;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ms = wait_ms;
+    }
+    return ms;
+}
+
+// Whether a Wait or WaitFrames is still running, counters are decremented by interrupts.
+static inline bool script_waiting(void)
+{
+    bool waiting;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        waiting = wait_ms != 0 || wait_frames != 0;
+    }
+    return waiting;
 }
 
 void EasyCon_decrease_report_echo(void)
 {
+    boot_reported = true;
+    report_frame = report_frame_count();
     // decrement echo counter
-    if (!_script_running || _report_echo > 0 || wait_ms < 2)
+    if (!_script_running || _report_echo > 0 || script_wait_ms() < 2)
     {
         _report_echo = Max(0, _report_echo - 1);
     }
+    // set interval until next report
+    switch (REPORT_POLICY(report_setting))
+    {
+    case POLICY_FIXED:
+        echo_ms = report_interval;
+        break;
+    case POLICY_MAX:
+        echo_ms = 0;
+        break;
+    case POLICY_KEEPALIVE:
+        echo_ms = EasyCon_report_changing() ? report_interval : KEEPALIVE_MS;
+        break;
+    case POLICY_ADAPTIVE:
+        if (EasyCon_report_changing())
+        {
+            report_idle = report_interval;
+            echo_ms = 0;
+        }
+        else
+        {
+            echo_ms = report_idle;
+            report_idle = Min(report_idle * 2, KEEPALIVE_MS);
+        }
+        break;
+    }
 }
 
 bool EasyCon_is_script_running(void)
@@ -115,27 +508,145 @@ bool EasyCon_is_script_running(void)
 void EasyCon_script_auto_start(void)
 {
     if (auto_run)
-        EasyCon_script_start();
+        EasyCon_script_request_start();
+}
+
+// Start script from main loop, for interrupts: verifying the image takes too long there.
+void EasyCon_script_request_start(void)
+{
+    start_request = true;
+}
+
+// Select next slot from main loop, for interrupts: selecting writes EEPROM.
+void EasyCon_script_request_select_next(void)
+{
+    select_request = true;
+}
+
+#if COMPRESSED_SCRIPT
+// Decode a block of compressed image into window, tokens past the block are cut off.
+static void script_decode_block(uint16_t block)
+{
+    uint8_t *src = script_base + EasyCon_read_2byte((uint16_t *)(script_base + BLOCK_INDEX + block * 2));
+    uint8_t n = 0, head, entry, count, length;
+    while (n < BLOCK_SIZE)
+    {
+        head = EasyCon_read_byte(src++);
+        if ((head & (TOKEN_ENTRY | TOKEN_REPEAT)) == TOKEN_LITERAL)
+        {
+            length = Min((head + 1) * 2, BLOCK_SIZE - n);
+            EasyCon_read_block(mem.window + n, src, length);
+            src += length;
+            n += length;
+            continue;
+        }
+        if (head & TOKEN_ENTRY)
+        {
+            entry = head & 0x7F;
+            count = 1;
+        }
+        else
+        {
+            entry = EasyCon_read_byte(src++);
+            count = (head & 0x3F) + 2;
+        }
+        // broken image, the rest reads like erased EEPROM
+        if (entry >= dict_size)
+            break;
+        for (; count > 0 && n < BLOCK_SIZE; count--)
+        {
+            length = Min(DICT_ENTRY, BLOCK_SIZE - n);
+            EasyCon_read_block(mem.window + n, dict_base + entry * DICT_ENTRY, length);
+            n += length;
+        }
+    }
+    memset(mem.window + n, 0xFF, BLOCK_SIZE - n);
+    window_block = block;
+}
+#endif
+
+// Read script at logical address, through window for compressed image.
+static void script_fetch(uint8_t *dst, uint16_t addr, uint16_t length)
+{
+#if COMPRESSED_SCRIPT
+    if (script_compressed)
+    {
+        for (; length > 0; length--, addr++)
+        {
+            if (addr / BLOCK_SIZE != window_block)
+                script_decode_block(addr / BLOCK_SIZE);
+            *dst++ = mem.window[addr % BLOCK_SIZE];
+        }
+        return;
+    }
+#endif
+    EasyCon_read_block(dst, script_base + addr, length);
 }
 
 // Run script.
 void EasyCon_script_start(void)
 {
-    script_addr = (uint8_t *)2;
-    uint16_t eof = EasyCon_read_byte((uint8_t *)0) | (EasyCon_read_byte((uint8_t *)1) << 8);
+    // recorded code is kept in the variables
+    if (recording)
+        return;
+    script_addr = (uint8_t *)script_entry;
+    script_generation++;
+    uint16_t eof = EasyCon_read_byte(script_base) | (EasyCon_read_byte(script_base + 1) << 8);
     if (eof == 0xFFFF)
         eof = 0;
+#if COMPRESSED_SCRIPT
+    script_compressed = (eof & COMPRESSED_FLAG) != 0;
+    window_block = BLOCK_NONE;
+    if (script_compressed)
+    {
+        eof &= ~COMPRESSED_FLAG;
+        dict_size = EasyCon_read_byte(script_base + 2);
+        dict_base = script_base + BLOCK_INDEX + ((eof & 0x7FFF) + BLOCK_SIZE - 1) / BLOCK_SIZE * 2;
+    }
+#else
+    // compressed image is not supported
+    if (eof & COMPRESSED_FLAG)
+        eof = 0;
+#endif
     script_eof = (uint8_t *)(eof & 0x7FFF);
+    // timer stops touching the motions while they are cleared
+    _script_running = 0;
     // reset variables
-    wait_ms = 0;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        wait_ms = 0;
+        wait_frames = 0;
+        timer_ms = 0;
+    }
     ///////////////////////////
     zero_echo();
     ///////////////////////////
-    timer_ms = 0;
     tail_wait = 0;
-    memset(mem + VARSPACE_OFFSET, 0, sizeof(mem) - VARSPACE_OFFSET);
+    // verify once per image, before the stacks are cleared
+    if (image_state == IMAGE_UNCHECKED)
+        image_state = EasyCon_script_verify();
+    // a pending host write is kept, it lands before the first instruction
+    memset(&mem.u.s.vm, 0, sizeof(mem.u.s.vm));
+    _report_echo = 0;
+#if REPORT_TRACE_LENGTH > 0
+    mem.trace_count = 0;
+    mem.trace_lost = 0;
+#endif
+#if EXEC_TRACE_LENGTH > 0
+    memset(&mem.exec, 0, sizeof(mem.exec));
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        mem.exec.time = exec_clock;
+    }
+#endif
+#if LAP_LOG_LENGTH > 0
+    mem.lap_count = 0;
+    mem.lap_head = 0;
+#endif
+#if SCRIPT_CACHE_SIZE > 0
+    script_fetch(mem.cache, 0, Min(SCRIPT_CACHE_SIZE, (uint16_t)script_eof));
+#endif
     _script_running = 1;
-    _seed = EasyCon_read_2byte((uint16_t *)SEED_OFFSET);
 
     if(_ledflag != 0) return;
     EasyCon_runningLED_on();
@@ -145,26 +656,92 @@ void EasyCon_script_start(void)
 void EasyCon_script_stop(void)
 {
     _script_running = 0;
+    start_request = false;
     timer_elapsed = timer_ms;
     ////////////////////////////
     reset_hid_report();
+    ClearOverlay();
     ///////////////////////////
-    _report_echo = ECHO_TIMES;
+    _report_echo = echo_times;
 
     EasyCon_runningLED_off();
 }
 
+// Read 2 bytes of script in one go, first one high, from cache if possible.
+static inline uint16_t script_read_pair(uint16_t addr)
+{
+    uint8_t b[2];
+#if SCRIPT_CACHE_SIZE > 0
+    if (addr < SCRIPT_CACHE_SIZE - 1)
+        return (mem.cache[addr] << 8) | mem.cache[addr + 1];
+#endif
+#if COMPRESSED_SCRIPT
+    // within decoded block
+    if (addr / BLOCK_SIZE == window_block && addr % BLOCK_SIZE < BLOCK_SIZE - 1)
+        return (mem.window[addr % BLOCK_SIZE] << 8) | mem.window[addr % BLOCK_SIZE + 1];
+#endif
+    script_fetch(b, addr, 2);
+    return (b[0] << 8) | b[1];
+}
+
 // Process script instructions.
 void EasyCon_script_task(void)
 {
+    vm_context_t ctx; // interpreter registers
+    uint16_t pc;      // address of next instruction
+    uint8_t generation;
+    uint_reg_t sreg;
+#ifdef EASYCON_BENCH
+    uint16_t cycles;
+#endif
+    if (select_request)
+    {
+        select_request = false;
+        EasyCon_script_select_next();
+    }
+    if (start_request)
+    {
+        start_request = false;
+        EasyCon_script_start();
+    }
+#if HOT_SWAP
+    // a running script swaps at its next instruction boundary
+    if (swap_pending && !_script_running)
+        EasyCon_script_swap();
+#endif
+    // nothing to run, leave the context alone
+    if (!_script_running || (script_waiting() && inject_reg == REGISTER_NONE))
+        return;
+#ifdef EASYCON_BENCH
+    cycles = Bench_Cycles();
+#endif
+    generation = script_generation;
+    ctx = mem.u.s.vm.ctx;
+    pc = (uint16_t)script_addr;
+#ifdef EASYCON_BENCH
+    Bench_Context(Bench_Cycles() - cycles);
+#endif
     while (true)
     {
+        if (generation != script_generation)
+        {
+            // restarted from an interrupt, continue with fresh context
+            generation = script_generation;
+            ctx = mem.u.s.vm.ctx;
+            pc = (uint16_t)script_addr;
+        }
         // status check
         if (!_script_running)
-            return;
+            goto yield;
+        // host write
+        if (inject_reg != REGISTER_NONE)
+        {
+            REG(inject_reg) = inject_value;
+            inject_reg = REGISTER_NONE;
+        }
         // timer check
-        if (wait_ms > 0)
-            return;
+        if (script_waiting())
+            goto yield;
         // release keys
         if(_ledflag == 0)
             EasyCon_blink_led();
@@ -179,25 +756,25 @@ void EasyCon_script_task(void)
                     {
                         // LS
                         SetLeftStick(STICK_CENTER, STICK_CENTER);
-                        _report_echo = ECHO_TIMES;
+                        _report_echo = echo_times;
                     }
                     else if (i == 33)
                     {
                         // RS
                         SetRightStick(STICK_CENTER, STICK_CENTER);
-                        _report_echo = ECHO_TIMES;
+                        _report_echo = echo_times;
                     }
                     else if ((i & 0x10) == 0)
                     {
                         // Button
                         ReleaseButtons(_BV(i));
-                        _report_echo = ECHO_TIMES;
+                        _report_echo = echo_times;
                     }
                     else
                     {
                         // HAT
                         SetHATSwitch(HAT_CENTER);
-                        _report_echo = ECHO_TIMES;
+                        _report_echo = echo_times;
                     }
                 }
             }
@@ -207,17 +784,29 @@ void EasyCon_script_task(void)
             // wait after compressed instruction
             SETWAIT(tail_wait);
             tail_wait = 0;
-            return;
+            goto yield;
+        }
+#if HOT_SWAP
+        if (swap_pending)
+        {
+            // no wait in progress, restart on new image
+            EasyCon_script_swap();
+            continue;
         }
-        if (script_addr >= script_eof)
+#endif
+        if (pc >= (uint16_t)script_eof)
         {
             // reaches EOF, end script
             EasyCon_script_stop();
-            return;
+            goto yield;
         }
-        _addr = (uint16_t)script_addr;
-        _ins0 = EasyCon_read_byte(script_addr++);
-        _ins1 = EasyCon_read_byte(script_addr++);
+#ifdef EASYCON_BENCH
+        cycles = Bench_Cycles();
+#endif
+        _addr = pc;
+        EXEC_TRACE(_addr);
+        _ins = script_read_pair(pc);
+        pc += 2;
         int32_t n;
         int16_t reg;
         if (_ins0 & 0b10000000)
@@ -232,13 +821,13 @@ void EasyCon_script_task(void)
                 {
                     // Button
                     PressButtons(_BV(_keycode));
-                    _report_echo = ECHO_TIMES;
+                    _report_echo = echo_times;
                 }
                 else
                 {
                     // HAT
                     SetHATSwitch(_keycode & 0xF);
-                    _report_echo = ECHO_TIMES;
+                    _report_echo = echo_times;
                 }
                 // post effect
                 if (E_SET)
@@ -278,18 +867,19 @@ void EasyCon_script_task(void)
                 _lr = (_ins0 >> 5) & 1;
                 _keycode = 32 | _lr;
                 _direction = _ins0 & 0b11111;
+                MOTION_CANCEL(_lr);
                 // modify report
                 if (_lr)
                 {
                     // RS
                     SetRightStick(DX(_direction), DY(_direction));
-                    _report_echo = ECHO_TIMES;
+                    _report_echo = echo_times;
                 }
                 else
                 {
                     // LS
                     SetLeftStick( DX(_direction), DY(_direction));
-                    _report_echo = ECHO_TIMES;
+                    _report_echo = echo_times;
                 }
                 // post effect
                 if (E_SET)
@@ -328,17 +918,19 @@ void EasyCon_script_task(void)
                 else
                 {
                     // Instruction : SerialPrint
+                    uint8_t print[2];
                     reg = _ins & ((1 << 9) - 1);
                     if ((_ins0 & 0b10) == 0)
                     {
-                        EasyCon_serial_send(reg);
-                        EasyCon_serial_send(reg >> 8);
+                        print[0] = reg;
+                        print[1] = reg >> 8;
                     }
                     else
                     {
-                        EasyCon_serial_send(mem[reg]);
-                        EasyCon_serial_send(mem[reg + 1]);
+                        print[0] = EasyCon_legacy_mem(reg);
+                        print[1] = EasyCon_legacy_mem(reg + 1);
                     }
+                    EasyCon_serial_notify(0, FRAME_PRINT, print, 2);
                     break;
                 }
                 break;
@@ -359,8 +951,8 @@ void EasyCon_script_task(void)
                 else if ((_ins0 & 0b10) == 0)
                 {
                     // extended
-                    _ins2 = EasyCon_read_byte(script_addr++);
-                    _ins3 = EasyCon_read_byte(script_addr++);
+                    _insArg = script_read_pair(pc);
+                    pc += 2;
                     n = _insEx & ((1L << 25) - 1);
                     // unscale
                     n *= 10;
@@ -377,6 +969,7 @@ void EasyCon_script_task(void)
                 if (_forstackindex == 0 || FOR_ADDR(_forstackindex - 1) != _addr)
                 {
                     // loop initialize
+                    CHECK(_forstackindex < FORSTACK_DEPTH && (_ins & ((1 << 11) - 1)) < (uint16_t)script_eof);
                     _forstackindex++;
                     FOR_I(_forstackindex - 1) = 0;
                     FOR_ADDR(_forstackindex - 1) = _addr;
@@ -413,11 +1006,12 @@ void EasyCon_script_task(void)
                 break;
             case 0b0011:
                 // Instruction : Next
+                CHECK(_forstackindex > 0);
                 if (_ins0 & 0b100)
                 {
                     // extended
-                    _ins2 = EasyCon_read_byte(script_addr++);
-                    _ins3 = EasyCon_read_byte(script_addr++);
+                    _insArg = script_read_pair(pc);
+                    pc += 2;
                 }
                 if (E_SET)
                 {
@@ -456,6 +1050,16 @@ void EasyCon_script_task(void)
                         // do nothing here
                     }
                 }
+                else if (FOR_ADDR(_forstackindex - 1) & FOR_SHORT)
+                {
+                    // 16-bit loop step, count of Next is not used
+                    FOR_I16(_forstackindex - 1)++;
+                    if (FOR_C16(_forstackindex - 1) == 0 || FOR_I16(_forstackindex - 1) < FOR_C16(_forstackindex - 1))
+                        JUMP(FOR_ADDR(_forstackindex - 1) & ~FOR_SHORT);
+                    else
+                        _forstackindex--;
+                    break;
+                }
                 else
                 {
                     // normal loop step
@@ -542,6 +1146,7 @@ void EasyCon_script_task(void)
                         if ((_ins1 & 0b10000) && !_flag)
                             break;
                         _v = _ins1 & 0b1111;
+                        CHECK(_v < _forstackindex);
                         _forstackindex -= _v;
                         E(1);
                         JUMP(FOR_NEXT(_forstackindex - 1));
@@ -551,6 +1156,7 @@ void EasyCon_script_task(void)
                         if ((_ins1 & 0b10000) && !_flag)
                             break;
                         _v = _ins1 & 0b1111;
+                        CHECK(_v < _forstackindex);
                         _forstackindex -= _v;
                         JUMP(FOR_NEXT(_forstackindex - 1));
                         break;
@@ -585,8 +1191,8 @@ void EasyCon_script_task(void)
                         if ((_ins1 & (1 << 6)) == 0)
                         {
                             // binary operations on instant
-                            _ins2 = EasyCon_read_byte(script_addr++);
-                            _ins3 = EasyCon_read_byte(script_addr++);
+                            _insArg = script_read_pair(pc);
+                            pc += 2;
                             _v = (_ins >> 3) & 0b111;
                             _ri0 = _ins & 0b111;
                             reg = _insEx;
@@ -653,6 +1259,7 @@ void EasyCon_script_task(void)
                         break;
                     case 0b0100:
                         // Instruction : Push
+                        CHECK(_stackindex < STACK_DEPTH);
                         _stackindex++;
                         STACK(_stackindex - 1) = REG(_ri0);
                         break;
@@ -660,6 +1267,8 @@ void EasyCon_script_task(void)
                         // Instruction : Pop
                         if (_ri0 == 0)
                             break;
+                        // pop balance is not covered by verification
+                        GUARD(_stackindex > 0);
                         REG(_ri0) = STACK(_stackindex - 1);
                         _stackindex--;
                         break;
@@ -677,13 +1286,12 @@ void EasyCon_script_task(void)
                         // Instruction : Rand
                         if (_ri0 == 0)
                             break;
-                        if (!_seed)
+                        if (!seed_drawn)
                         {
-                            _seed = timer_ms;
-                            EasyCon_write_2byte((uint16_t *)SEED_OFFSET, _seed);
-                            srand(_seed);
+                            seed_drawn = true;
+                            rand_state = (EasyCon_seed_next() ^ (uint16_t)script_timer_ms()) | 1;
                         }
-                        REG(_ri0) = rand() % REG(_ri0);
+                        REG(_ri0) = random_mod(&rand_state, REG(_ri0));
                         break;
                     }
                 }
@@ -710,192 +1318,1430 @@ void EasyCon_script_task(void)
                     break;
                 case 0b11:
                     // Instruction : Call
+                    CHECK(_callstackindex < CALLSTACK_DEPTH);
                     _callstackindex++;
-                    STACK(_callstackindex - 1) = (int16_t)script_addr;
+                    CALLSTACK(_callstackindex - 1) = pc;
                     JUMPNEAR(reg);
                     break;
                 }
+                CHECK(pc >= 2 && pc <= (uint16_t)script_eof);
+                break;
+            case 0b0111:
+                // Instruction : StickMotion
+                n = 0;
+                if (_ins0 & 0b11)
+                {
+                    _insArg = script_read_pair(pc);
+                    pc += 2;
+                }
+                if ((_ins0 & 0b11) == 0b10)
+                {
+                    // arc duration
+                    n = script_read_pair(pc);
+                    pc += 2;
+                }
+#if STICK_MOTION
+                EasyCon_motion_start(ctx.ins, n);
+#endif
+                break;
+            case 0b1000:
+                // Instruction : WaitFrames
+                ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+                {
+                    wait_frames = _ins & ((1 << 11) - 1);
+                }
+                break;
+            case 0b1001:
+                // Instruction : ForCount, address of Next then 16-bit count, 0 for infinite loop
+                _insArg = script_read_pair(pc);
+                pc += 2;
+                if (_forstackindex == 0 || FOR_ADDR(_forstackindex - 1) != (pc | FOR_SHORT))
+                {
+                    // whole loop set up here, Next only steps it
+                    CHECK(_forstackindex < FORSTACK_DEPTH && (_ins & ((1 << 11) - 1)) < (uint16_t)script_eof);
+                    _forstackindex++;
+                    FOR_I(_forstackindex - 1) = 0;
+                    FOR_C(_forstackindex - 1) = _insArg;
+                    FOR_ADDR(_forstackindex - 1) = pc | FOR_SHORT;
+                    FOR_NEXT(_forstackindex - 1) = _ins & ((1 << 11) - 1);
+                }
+                break;
+            case 0b1010:
+                // Instruction : Lap, tag in ins1
+#if LAP_LOG_LENGTH > 0
+                // log is not moved while it is being sent, the marker is dropped
+                if (dump_cmd == CMD_LAPS)
+                    break;
+                mem.lap[mem.lap_head].tag = _ins1;
+                mem.lap[mem.lap_head].time = script_timer_ms();
+                mem.lap_head = (mem.lap_head + 1) & (LAP_LOG_LENGTH - 1);
+                if (mem.lap_count != 0xFFFF)
+                    mem.lap_count++;
+#endif
+                break;
+            case 0b1011:
+                // Instruction : SetReport, whole report in one go, then optional hold in 10 ms units
+            {
+                uint16_t button;
+                uint8_t hat, stick[4];
+                if ((_ins0 & 0b100) == 0)
+                {
+                    // inline: buttons (2), HAT, LX, LY, RX, RY, reserved
+                    button = script_read_pair(pc);
+                    reg = script_read_pair(pc + 2);
+                    hat = reg >> 8;
+                    stick[0] = reg;
+                    reg = script_read_pair(pc + 4);
+                    stick[1] = reg >> 8;
+                    stick[2] = reg;
+                    stick[3] = script_read_pair(pc + 6) >> 8;
+                    pc += 8;
+                }
+                else
+                {
+                    // from registers: buttons, HAT, LX | LY << 8, RX | RY << 8
+                    _ri0 = script_read_pair(pc) >> 8;
+                    pc += 2;
+                    CHECK(_ri0 <= REGISTER_COUNT - 4);
+                    button = REG(_ri0);
+                    hat = REG(_ri0 + 1);
+                    stick[0] = REG(_ri0 + 2);
+                    stick[1] = REG(_ri0 + 2) >> 8;
+                    stick[2] = REG(_ri0 + 3);
+                    stick[3] = REG(_ri0 + 3) >> 8;
+                }
+                MOTION_CANCEL(0);
+                MOTION_CANCEL(1);
+                SetReport(button, hat, stick[0], stick[1], stick[2], stick[3]);
+                _report_echo = echo_times;
+                // replaces whatever was held before
+                memset(mem.u.s.vm.key, 0, sizeof(mem.u.s.vm.key));
+                if (E_SET)
+                    n = REG(_e_val);
+                else
+                    n = (_ins & ((1 << 10) - 1)) * 10;
+                if (n != 0)
+                {
+                    // hold, released before next instruction
+                    SETWAIT(n);
+                    for (uint8_t i = 0; i < 16; i++)
+                        if (button & _BV(i))
+                            RESETAFTER(i, 1);
+                    if (hat != HAT_CENTER)
+                        RESETAFTER(0x10 | (hat & 0xF), 1);
+                    if (stick[0] != STICK_CENTER || stick[1] != STICK_CENTER)
+                        RESETAFTER(32, 1);
+                    if (stick[2] != STICK_CENTER || stick[3] != STICK_CENTER)
+                        RESETAFTER(33, 1);
+                }
                 break;
             }
+            }
         }
+#ifdef EASYCON_BENCH
+        Bench_Instruction(Bench_Cycles() - cycles);
+#endif
     }
+yield:
+    // save context, unless the script was restarted meanwhile
+#ifdef EASYCON_BENCH
+    cycles = Bench_Cycles();
+#endif
+    sreg = GetGlobalInterruptMask();
+    GlobalInterruptDisable();
+    if (generation == script_generation)
+    {
+        mem.u.s.vm.ctx = ctx;
+        script_addr = (uint8_t *)pc;
+    }
+    SetGlobalInterruptMask(sreg);
+#ifdef EASYCON_BENCH
+    Bench_Context(Bench_Cycles() - cycles);
+#endif
 }
 
-// Perform binary operations by operator code
-static void EasyCon_binaryop(uint8_t op, uint8_t reg, int16_t value)
+#if STICK_MOTION
+// quarter sine wave, 255 * sin(i / 256 turn)
+static const uint8_t sine_table[65] EASYCON_CONST = {
+    0, 6, 13, 19, 25, 31, 37, 44, 50, 56, 62, 68, 74, 80, 86, 92,
+    98, 103, 109, 115, 120, 126, 131, 136, 142, 147, 152, 157, 162, 167, 171, 176,
+    180, 185, 189, 193, 197, 201, 205, 208, 212, 215, 219, 222, 225, 228, 231, 233,
+    236, 238, 240, 242, 244, 246, 247, 249, 250, 251, 252, 253, 254, 254, 255, 255,
+    255};
+
+// 255 * sin(angle), angle in 1/256 turn
+static int16_t motion_sin(uint8_t angle)
 {
-    if (reg == 0)
-        return;
-    switch (op)
+    uint8_t i = angle & 0x3F;
+    if (angle & 0x40)
+        i = 64 - i;
+    int16_t v = EasyCon_read_const_byte(&sine_table[i]);
+    return (angle & 0x80) ? -v : v;
+}
+
+static void motion_set_stick(uint8_t lr, uint8_t x, uint8_t y)
+{
+    if (lr)
+        SetRightStick(x, y);
+    else
+        SetLeftStick(x, y);
+}
+
+/* Start stick motion from current instruction.
+ * ins0 = 0 0111 s mm, s for LS/RS
+ * mm 00 : stop, stick centered
+ * mm 01 : ramp from current position to direction ins1 (0x20 for center) in ins2,ins3 ms
+ * mm 10 : arc of radius ins1, from angle ins2 (1/256 turn), sweeping ins3 (signed, 1/128 turn) in duration ms
+ * mm 11 : endless circle of radius ins1, one turn per ins2,ins3 ms, counterclockwise with highest bit set
+ */
+static void EasyCon_motion_start(ins_t ins, uint16_t duration)
+{
+    volatile motion_t *m;
+    uint8_t x, y;
+    int32_t sweep;
+    uint8_t lr = (ins.b[3] >> 2) & 1;
+    m = &MOTION(lr);
+    // the tick leaves a stopped motion alone, so it can be set up safely
+    m->mode = MOTION_NONE;
+    KEY(32 | lr) = 0;
+    m->radius = Min(ins.b[2], 128);
+    switch (ins.b[3] & 0b11)
     {
-    case 0b000:
-        // Mov
-        REG(reg) = value;
-        break;
-    case 0b001:
-        // Add
-        REG(reg) += value;
-        break;
-    case 0b010:
-        // Mul
-        REG(reg) *= value;
-        break;
-    case 0b011:
-        // Div
-        REG(reg) /= value;
-        break;
-    case 0b100:
-        // Mod
-        REG(reg) %= value;
-        break;
-    case 0b101:
-        // And
-        REG(reg) &= value;
+    case 0b00:
+        motion_set_stick(lr, STICK_CENTER, STICK_CENTER);
+        _report_echo = echo_times;
+        return;
+    case 0b01:
+        // at least 2 ms, so full scale 255 * 256 / duration fits the 16 bit step
+        duration = Max((uint16_t)ins.ex, 2);
+        if (lr)
+            GetRightStick(&x, &y);
+        else
+            GetLeftStick(&x, &y);
+        m->u.ramp.tx = (ins.b[2] & 0x20) ? STICK_CENTER : DX(ins.b[2] & 0b11111);
+        m->u.ramp.ty = (ins.b[2] & 0x20) ? STICK_CENTER : DY(ins.b[2] & 0b11111);
+        m->u.ramp.x = x << 8;
+        m->u.ramp.y = y << 8;
+        m->u.ramp.dx = (int32_t)(m->u.ramp.tx - x) * 256 / duration;
+        m->u.ramp.dy = (int32_t)(m->u.ramp.ty - y) * 256 / duration;
+        m->remaining = duration;
+        m->mode = MOTION_RAMP;
         break;
-    case 0b110:
-        // Or
-        REG(reg) |= value;
+    case 0b10:
+        duration = Max(duration, 1);
+        sweep = (int8_t)ins.b[0] * 512L;
+        m->u.rot.phase = ins.b[1] << 8;
+        m->u.rot.end = m->u.rot.phase + sweep;
+        m->u.rot.step = sweep / duration;
+        m->remaining = duration;
+        m->mode = MOTION_ARC;
         break;
-    case 0b111:
-        // Xor
-        REG(reg) ^= value;
+    case 0b11:
+        duration = Max((uint16_t)(ins.ex & 0x7FFF), 3);
+        m->u.rot.phase = 0;
+        m->u.rot.step = 0x10000L / duration;
+        if (ins.b[1] & 0x80)
+            m->u.rot.step = -m->u.rot.step;
+        m->mode = MOTION_CIRCLE;
         break;
     }
 }
 
-// Process data from serial port.
-void EasyCon_serial_task(int16_t byte)
+// Advance stick motions by 1 ms, called from timer tick.
+static void EasyCon_motion_tick(void)
 {
-    if (byte < 0)
-        return;
-    if(_ledflag == 0)
-        EasyCon_blink_led();
-    if (flash_index < flash_count)
-    {
-        // flashing
-        SERIAL_BUFFER(flash_index) = byte;
-        flash_index++;
-        if (flash_index == flash_count)
-        {
-            // all bytes received
-            for (flash_index = 0; flash_index < flash_count; flash_index++, flash_addr++)
-                EasyCon_write_byte(flash_addr, SERIAL_BUFFER(flash_index));
-            EasyCon_serial_send(REPLY_FLASHEND);
-        }
-    }
-    else
+    volatile motion_t *m;
+    uint8_t x, y, angle;
+    for (uint8_t lr = 0; lr < 2; lr++)
     {
-        // regular
-        SERIAL_BUFFER(serial_buffer_length++) = byte;
-        // check control byte
-        if ((byte & 0x80) != 0)
+        m = &MOTION(lr);
+        if (m->mode == MOTION_NONE)
+            continue;
+        if (m->mode == MOTION_RAMP)
         {
-            if (serial_buffer_length == 1 && !serial_command_ready && byte == CMD_READY)
+            if (--m->remaining == 0)
             {
-                // comand ready
-                serial_command_ready = true;
+                m->u.ramp.x = m->u.ramp.tx << 8;
+                m->u.ramp.y = m->u.ramp.ty << 8;
+                m->mode = MOTION_NONE;
             }
-            else if (serial_buffer_length == 8)
+            else
             {
-                // report data
-                if (_script_running)
-                {
-                    // script running, send BUSY
-                    EasyCon_serial_send(REPLY_BUSY);
-                }
-                else
-                {
-                    //memset(&next_report, 0, sizeof(USB_JoystickReport_Input_t));
-                    SetButtons( (SERIAL_BUFFER(0) << 9) | (SERIAL_BUFFER(1) << 2) | (SERIAL_BUFFER(2) >> 5) );
-                    SetHATSwitch( (uint8_t)((SERIAL_BUFFER(2) << 3) | (SERIAL_BUFFER(3) >> 4)) );
-                    SetLeftStick( (uint8_t)((SERIAL_BUFFER(3) << 4) | (SERIAL_BUFFER(4) >> 3)),
-                                    (uint8_t)((SERIAL_BUFFER(4) << 5) | (SERIAL_BUFFER(5) >> 2)));
-                    SetRightStick( (uint8_t)((SERIAL_BUFFER(5) << 6) | (SERIAL_BUFFER(6) >> 1)),
-                                    (uint8_t)((SERIAL_BUFFER(6) << 7) | (SERIAL_BUFFER(7) & 0x7f)));
-                    // set flag
-                    _report_echo = ECHO_TIMES;
-                    // send ACK
-                    EasyCon_serial_send(REPLY_ACK);
-                }
-                serial_command_ready = false;
+                m->u.ramp.x += m->u.ramp.dx;
+                m->u.ramp.y += m->u.ramp.dy;
             }
-            else if (serial_command_ready)
+            x = m->u.ramp.x >> 8;
+            y = m->u.ramp.y >> 8;
+        }
+        else
+        {
+            if (m->mode == MOTION_ARC && --m->remaining == 0)
             {
-                serial_command_ready = false;
-                // command
-                switch (byte)
-                {
-                case CMD_DEBUG:;
-                    uint32_t n;
-                    // instruction count
-                    //uint8_t* count = (uint8_t*)(eeprom_read_byte((uint8_t*)0) | (eeprom_read_byte((uint8_t*)1) << 8));
-                    //for (uint8_t* i = 0; i < count; i++)
-                    //EasyCon_serial_send(eeprom_read_byte(i));
+                m->u.rot.phase = m->u.rot.end;
+                m->mode = MOTION_NONE;
+            }
+            else
+                m->u.rot.phase += m->u.rot.step;
+            angle = m->u.rot.phase >> 8;
+            // up is y = 0
+            x = STICK_CENTER + ((m->radius * motion_sin(angle)) >> 8);
+            y = STICK_CENTER + ((m->radius * motion_sin(angle + 192)) >> 8);
+        }
+        motion_set_stick(lr, x, y);
+    }
+}
+#endif
 
-                    // current loop variable
-                    n = FOR_I(_forstackindex - 1);
-                    for (int i = 0; i < 4; i++)
+// Check branch targets, loop structure and stack usage of script image.
+// Only a conservative subset is accepted: forward branches that stay inside their loop,
+// properly nested For/Next, and bounded push/call depth. Anything else runs with runtime checks.
+static uint8_t EasyCon_script_verify(void)
+{
+    uint16_t eof = (uint16_t)script_eof;
+    uint16_t addr = 2;
+    uint16_t target;
+    uint8_t ins0, ins1, i;
+    uint8_t code[2];
+    uint8_t depth = 0, maxdepth = 0, pending = 0;
+    uint8_t pushes = 0, calls = 0;
+    uint16_t calldepth = 0; // loop depth summed over call sites
+    bool storeop = false;
+    // entry point must start at top level
+    VERIFY_TARGET(0) = script_entry;
+    VERIFY_DEPTH(0) = 0x80;
+    pending = 1;
+    while (true)
+    {
+        // resolve pending targets at this address
+        for (i = 0; i < pending;)
+        {
+            if (VERIFY_TARGET(i) < addr)
+                return IMAGE_UNVERIFIED; // target inside an instruction
+            if (VERIFY_TARGET(i) == addr)
+            {
+                if ((VERIFY_DEPTH(i) & 0x7F) != depth)
+                    return IMAGE_UNVERIFIED;
+                pending--;
+                VERIFY_TARGET(i) = VERIFY_TARGET(pending);
+                VERIFY_DEPTH(i) = VERIFY_DEPTH(pending);
+            }
+            else
+                i++;
+        }
+        if (addr >= eof)
+            break;
+        script_fetch(code, addr, 2);
+        ins0 = code[0];
+        ins1 = code[1];
+        if (storeop)
+        {
+            // pre-loaded argument must be consumed right away, and never by an extended Wait
+            storeop = false;
+            if ((ins0 & 0b10000000) == 0 && ((ins0 >> 3) & 0b1111) != 0b0010 && ((ins0 >> 3) & 0b1111) != 0b1011 &&
+                (((ins0 >> 3) & 0b1111) != 0b0001 || (ins0 & 0b110) == 0b100))
+                return IMAGE_UNVERIFIED;
+        }
+        if ((ins0 & 0b10000000) == 0)
+        {
+            switch ((ins0 >> 3) & 0b1111)
+            {
+            case 0b0001:
+                // Wait, extended
+                if ((ins0 & 0b110) == 0b100)
+                    addr += 2;
+                break;
+            case 0b1001:
+                // ForCount, count in 2 more bytes
+                addr += 2;
+                // fall through
+            case 0b0010:
+                // For
+                target = ((ins0 << 8) | ins1) & ((1 << 11) - 1);
+                if (target <= addr || target >= eof || depth >= FORSTACK_DEPTH)
+                    return IMAGE_UNVERIFIED;
+                if (depth != 0 && target >= VERIFY_NEXT(depth - 1))
+                    return IMAGE_UNVERIFIED;
+                VERIFY_NEXT(depth) = target;
+                depth++;
+                maxdepth = Max(maxdepth, depth);
+                break;
+            case 0b0011:
+                // Next
+                if (depth == 0 || VERIFY_NEXT(depth - 1) != addr)
+                    return IMAGE_UNVERIFIED;
+                if (ins0 & 0b100)
+                    addr += 2;
+                depth--;
+                // branches must not leave their loop
+                for (i = 0; i < pending; i++)
+                    if ((VERIFY_DEPTH(i) & 0x80) == 0 && VERIFY_DEPTH(i) > depth)
+                        return IMAGE_UNVERIFIED;
+                break;
+            case 0b0100:
+                if ((ins0 & 0b100) == 0)
+                {
+                    if ((ins1 >> 5) == 0b000 || (ins1 >> 5) == 0b001)
                     {
-                        EasyCon_serial_send(n);
-                        n >>= 8;
+                        // Break/Continue
+                        if ((ins1 & 0b1111) >= depth)
+                            return IMAGE_UNVERIFIED;
                     }
-
-                    // time elapsed
-                    n = timer_elapsed;
-                    for (int i = 0; i < 4; i++)
+                    else if ((ins1 >> 5) == 0b111)
                     {
-                        EasyCon_serial_send(n);
-                        n >>= 8;
+                        // Return, would leave its loops on the stack
+                        if (depth != 0)
+                            return IMAGE_UNVERIFIED;
                     }
-
-                    // PC
-                    n = (uint16_t)script_addr;
-                    for (int i = 0; i < 2; i++)
+                }
+                break;
+            case 0b0101:
+                if ((ins0 & 0b100) == 0)
+                {
+                    // binary operations on instant
+                    if ((((ins0 << 8) | ins1) & (0b111 << 7)) == 0 && (ins1 & (1 << 6)) == 0)
+                        addr += 2;
+                }
+                else if ((ins0 & 0b111) == 0b111)
+                {
+                    if (((ins1 >> 3) & 0b1111) == 0b0100)
                     {
-                        EasyCon_serial_send(n);
-                        n >>= 8;
+                        // Push
+                        if (depth != 0)
+                            return IMAGE_UNVERIFIED;
+                        pushes++;
                     }
-                    break;
-                case CMD_VERSION:
-                    EasyCon_serial_send(VERSION);
-                    break;
-                case CMD_LED:
-                    _ledflag ^= 0x8;
-                    EasyCon_write_byte((uint8_t *)LED_SETTING, _ledflag);
-                    EasyCon_runningLED_off();
-                    EasyCon_serial_send(_ledflag);
-                    break;
-                case CMD_READY:
-                    serial_command_ready = true;
-                    break;
-                case CMD_HELLO:
-                    EasyCon_serial_send(REPLY_HELLO);
-                    break;
-                case CMD_FLASH:
-                    if (serial_buffer_length != 5)
+                    else if (((ins1 >> 3) & 0b1111) == 0b0111)
                     {
-                        EasyCon_serial_send(REPLY_ERROR);
-                        break;
+                        // StoreOp
+                        storeop = true;
                     }
-                    EasyCon_script_stop();
-                    flash_addr = (uint8_t *)(SERIAL_BUFFER(0) | (SERIAL_BUFFER(1) << 7));
-                    flash_count = (SERIAL_BUFFER(2) | (SERIAL_BUFFER(3) << 7));
-                    flash_index = 0;
-                    EasyCon_serial_send(REPLY_FLASHSTART);
-                    break;
-                case CMD_SCRIPTSTART:
-                    EasyCon_script_start();
-                    EasyCon_serial_send(REPLY_SCRIPTACK);
-                    break;
-                case CMD_SCRIPTSTOP:
-                    EasyCon_script_stop();
-                    EasyCon_serial_send(REPLY_SCRIPTACK);
-                    break;
-                default:
-                    // error
-                    EasyCon_serial_send(REPLY_ERROR);
+                }
+                break;
+            case 0b1011:
+                // SetReport, 8 inline bytes or a register index
+                if ((ins0 & 0b100) == 0)
+                {
+                    addr += 8;
                     break;
                 }
+                script_fetch(code, addr + 2, 2);
+                if (code[0] > REGISTER_COUNT - 4)
+                    return IMAGE_UNVERIFIED;
+                addr += 2;
+                break;
+            case 0b0111:
+                // StickMotion, arc has 4 more bytes
+                if (ins0 & 0b11)
+                    addr += 2;
+                if ((ins0 & 0b11) == 0b10)
+                    addr += 2;
+                break;
+            case 0b0110:
+                // branches, forward only
+                target = ((ins0 << 8) | ins1) & ((1 << 9) - 1);
+                target = addr + 2 + ((int16_t)(target << 7) >> 6);
+                if (target <= addr || target > eof || pending >= VERIFY_PENDING_MAX)
+                    return IMAGE_UNVERIFIED;
+                VERIFY_TARGET(pending) = target;
+                VERIFY_DEPTH(pending) = depth;
+                if (((ins0 >> 1) & 0b11) == 0b11)
+                {
+                    // Call, target must be outside loops
+                    VERIFY_DEPTH(pending) = 0x80;
+                    calls++;
+                    calldepth += depth;
+                }
+                pending++;
+                break;
+            }
+        }
+        addr += 2;
+    }
+    // all instructions end exactly at EOF, with all loops and targets closed
+    if (addr != eof || depth != 0 || pending != 0 || storeop)
+        return IMAGE_UNVERIFIED;
+    if (calls == 0)
+        return pushes <= STACK_DEPTH ? IMAGE_VERIFIED : IMAGE_UNVERIFIED;
+    // calls only go forward, so each call site is active at most once
+    if (pushes != 0 || calls > CALLSTACK_DEPTH || calldepth + maxdepth > FORSTACK_DEPTH)
+        return IMAGE_UNVERIFIED;
+    return IMAGE_VERIFIED;
+}
+
+#if HOT_SWAP
+// Switch active slot to staged image, and restart if running.
+static void EasyCon_script_swap(void)
+{
+    uint16_t entry = (stage_image << 13) | 2;
+    // serial interrupt sees either the old state or the new one
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        active_image = stage_image;
+        stage_image = STAGE_NONE;
+        script_base = (uint8_t *)IMAGE_BASE(active_image);
+        script_entry = 2;
+        image_state = IMAGE_UNCHECKED;
+        auto_run = (EasyCon_read_byte(script_base + 1) >> 7) == 0;
+        // directory entry is written in background, buffer is free after commit
+        // a pending FLASHEND is sent once it is written
+        stage_buffer[0] = entry;
+        stage_buffer[1] = entry >> 8;
+        stage_addr = (uint8_t *)(SLOT_DIRECTORY + (script_slot << 1));
+        stage_index = 0;
+        stage_count = 2;
+        swap_pending = false;
+    }
+    if (_script_running)
+    {
+        // release everything held by old script
+        reset_hid_report();
+        EasyCon_script_start();
+    }
+}
+#endif
+
+// Write staged bytes to EEPROM, one byte whenever EEPROM is idle.
+void EasyCon_stage_task(void)
+{
+#if HOT_SWAP
+    if (stage_count == 0 && stage_reply)
+    {
+        // all written, retried while serial is busy
+        uint8_t reply = REPLY_FLASHEND;
+        if (EasyCon_serial_notify(stage_seq, CMD_FLASH, &reply, 1))
+            stage_reply = false;
+        return;
+    }
+    if (stage_count == 0 || !EasyCon_eeprom_ready())
+        return;
+    EasyCon_write_byte(stage_addr++, stage_buffer[stage_index++]);
+    stage_count--;
+#endif
+}
+
+// Append an instruction to recorded macro, false when full.
+static bool EasyCon_record_emit(uint8_t ins0, uint8_t ins1)
+{
+    if (record_truncated || record_length + 2 > RECORD_BUFFER_SIZE)
+    {
+        record_truncated = true;
+        return false;
+    }
+    RECORD_BUFFER(record_length++) = ins0;
+    RECORD_BUFFER(record_length++) = ins1;
+    return true;
+}
+
+// Record time passed since last recorded change, in 10 ms steps without drift.
+static void EasyCon_record_wait(void)
+{
+    uint32_t units = (timer_ms - record_start - record_time + 5) / 10;
+    record_time += units * 10;
+    while (units > 0)
+    {
+        uint16_t n = Min(units, 1023);
+        EasyCon_record_emit(0x08 | (n >> 8), n);
+        units -= n;
+    }
+}
+
+// Nearest stick direction of direction_table, DIRECTION_NONE near center.
+static uint8_t EasyCon_record_direction(uint8_t x, uint8_t y)
+{
+    int16_t dx = x - STICK_CENTER, dy = y - STICK_CENTER;
+    int16_t m = Max(abs(dx), abs(dy));
+    if (m < RECORD_DEADZONE)
+        return DIRECTION_NONE;
+    // project onto the square of the table, -128 ~ 128
+    dx = dx * 128 / m;
+    dy = dy * 128 / m;
+    if (-dy >= abs(dx))
+        return (dx + 128 + 16) >> 5; // top, 0 ~ 8
+    if (dx >= abs(dy))
+        return 8 + ((dy + 128 + 16) >> 5);
+    if (dy >= abs(dx))
+        return 16 + ((128 - dx + 16) >> 5);
+    return (24 + ((128 - dy + 16) >> 5)) & 31;
+}
+
+// Encode changes of a report frame: held keys and sticks, released with hold 1 before next instruction.
+static void EasyCon_record_frame(uint16_t button, uint8_t hat, uint8_t lx, uint8_t ly, uint8_t rx, uint8_t ry)
+{
+    uint8_t stick[2];
+    uint16_t changed = button ^ record_button;
+    hat &= 0xF;
+    stick[0] = EasyCon_record_direction(lx, ly);
+    stick[1] = EasyCon_record_direction(rx, ry);
+    if (changed == 0 && hat == record_hat && stick[0] == record_stick[0] && stick[1] == record_stick[1])
+        return;
+    EasyCon_record_wait();
+    for (uint8_t i = 0; i < 16; i++)
+        if (changed & _BV(i))
+            EasyCon_record_emit(0x80 | (i << 1) | 1, (button & _BV(i)) ? 0x80 : 0x81);
+    if (hat != record_hat)
+        EasyCon_record_emit(0x80 | ((0x10 | hat) << 1) | 1, 0x80);
+    for (uint8_t lr = 0; lr < 2; lr++)
+    {
+        if (stick[lr] == record_stick[lr])
+            continue;
+        if (stick[lr] == DIRECTION_NONE)
+            EasyCon_record_emit(0xC0 | (lr << 5) | record_stick[lr], 0x81);
+        else
+            EasyCon_record_emit(0xC0 | (lr << 5) | stick[lr], 0x80);
+    }
+    record_button = button;
+    record_hat = hat;
+    record_stick[0] = stick[0];
+    record_stick[1] = stick[1];
+}
+
+// Start recording from current report.
+static void EasyCon_record_start(void)
+{
+    uint8_t report[sizeof(USB_JoystickReport_Input_t)];
+    if (_script_running)
+        EasyCon_script_stop();
+    recording = true;
+    record_truncated = false;
+    record_length = 0;
+    record_start = timer_ms;
+    record_time = 0;
+    record_button = 0;
+    record_hat = HAT_CENTER;
+    record_stick[0] = DIRECTION_NONE;
+    record_stick[1] = DIRECTION_NONE;
+    GetReport(report);
+    EasyCon_record_frame(report[0] | (report[1] << 8), report[2], report[3], report[4], report[5], report[6]);
+}
+
+// Finish recording and write it as script of active image, started manually.
+// Only the image is written, the slot directory is left to CMD_SLOT.
+static void EasyCon_record_save(void)
+{
+    // keep the last state as long as it was held
+    EasyCon_record_wait();
+    recording = false;
+    EasyCon_update_block(script_base + 2, &RECORD_BUFFER(0), record_length);
+    EasyCon_write_2byte((uint16_t *)script_base, (2 + record_length) | 0x8000);
+    image_state = IMAGE_UNCHECKED;
+    auto_run = false;
+}
+
+// Take next seed from journal, once per power cycle.
+// Each seed goes to the next entry, spreading EEPROM wear over the journal.
+static uint16_t EasyCon_seed_next(void)
+{
+    uint16_t *journal = (uint16_t *)SEED_JOURNAL;
+    uint16_t seed = 0xFFFF, next;
+    uint8_t i, newest = SEED_JOURNAL_LENGTH - 1;
+    for (i = 0; i < SEED_JOURNAL_LENGTH; i++)
+    {
+        seed = EasyCon_read_2byte(journal + i);
+        next = EasyCon_read_2byte(journal + (i + 1) % SEED_JOURNAL_LENGTH);
+        if (seed != 0xFFFF && next != (seed == 0xFFFE ? 0 : seed + 1))
+        {
+            newest = i;
+            break;
+        }
+    }
+    if (i == SEED_JOURNAL_LENGTH)
+    {
+        // empty journal, continue from old seed location
+        seed = EasyCon_read_2byte((uint16_t *)SEED_OFFSET);
+    }
+    seed++;
+    if (seed == 0xFFFF)
+        seed = 0;
+    EasyCon_write_2byte(journal + (newest + 1) % SEED_JOURNAL_LENGTH, seed);
+    return seed;
+}
+
+// Read a byte of variables by its offset in the old fixed layout.
+// Only registers are addressed by scripts, the rest reads as zero.
+static uint8_t EasyCon_legacy_mem(uint16_t offset)
+{
+    offset -= LEGACY_REGISTER_OFFSET;
+    if (offset >= REGISTER_COUNT * 2)
+        return 0;
+    return (uint8_t)(REG(offset >> 1) >> ((offset & 1) << 3));
+}
+
+// Perform binary operations by operator code
+static void EasyCon_binaryop(uint8_t op, uint8_t reg, int16_t value)
+{
+    if (reg == 0)
+        return;
+    switch (op)
+    {
+    case 0b000:
+        // Mov
+        REG(reg) = value;
+        break;
+    case 0b001:
+        // Add
+        REG(reg) += value;
+        break;
+    case 0b010:
+        // Mul
+        REG(reg) *= value;
+        break;
+    case 0b011:
+        // Div
+        if (is_pow2(value))
+            REG(reg) = div_pow2(REG(reg), value);
+        else
+            REG(reg) /= value;
+        break;
+    case 0b100:
+        // Mod
+        if (is_pow2(value))
+            REG(reg) = mod_pow2(REG(reg), value);
+        else
+            REG(reg) %= value;
+        break;
+    case 0b101:
+        // And
+        REG(reg) &= value;
+        break;
+    case 0b110:
+        // Or
+        REG(reg) |= value;
+        break;
+    case 0b111:
+        // Xor
+        REG(reg) ^= value;
+        break;
+    }
+}
+
+// Read a 16-bit parameter, a 7-bit pair in v1 or little-endian in v2.
+static uint16_t serial_param16(uint8_t i)
+{
+    if (protocol == PROTOCOL_V2)
+        return SERIAL_BUFFER(i) | (SERIAL_BUFFER(i + 1) << 8);
+    return SERIAL_BUFFER(i) | (SERIAL_BUFFER(i + 1) << 7);
+}
+
+// Build a v2 frame from payload, return its size.
+static uint8_t EasyCon_frame_build(uint8_t *frame, uint8_t seq, uint8_t cmd, uint8_t flags, const uint8_t *data, uint8_t length)
+{
+    uint16_t crc = FRAME_CRC_INIT;
+    uint8_t n = 0;
+    frame[n++] = FRAME_SYNC;
+    frame[n++] = length | flags;
+    frame[n++] = seq;
+    frame[n++] = cmd;
+    memcpy(frame + n, data, length);
+    n += length;
+    for (uint8_t i = 1; i < n; i++)
+        crc = EasyCon_crc16_update(crc, frame[i]);
+    frame[n++] = crc;
+    frame[n++] = crc >> 8;
+    return n;
+}
+
+// Send buffered reply bytes as a frame of current command, called while receiving.
+static void EasyCon_reply_flush(uint8_t flags)
+{
+    uint8_t frame[FRAME_CHUNK + 6];
+    uint8_t n = EasyCon_frame_build(frame, frame_seq, frame_cmd, flags, reply_buffer, reply_length);
+    for (uint8_t i = 0; i < n; i++)
+        EasyCon_serial_send(frame[i]);
+    reply_length = 0;
+}
+
+// Reply a byte to current command: sent right away in v1, framed in v2.
+static void EasyCon_serial_reply(uint8_t byte)
+{
+    if (protocol != PROTOCOL_V2)
+    {
+        EasyCon_serial_send(byte);
+        return;
+    }
+    if (reply_length == FRAME_CHUNK)
+        EasyCon_reply_flush(FRAME_MORE);
+    reply_buffer[reply_length++] = byte;
+}
+
+// Send bytes not answering a command from main loop: as they are in v1, as a whole frame in v2.
+// A frame is dropped if serial is busy, return whether it was queued.
+static bool EasyCon_serial_notify(uint8_t seq, uint8_t cmd, const uint8_t *data, uint8_t length)
+{
+    uint8_t frame[FRAME_CHUNK + 6];
+    uint8_t n;
+    if (protocol != PROTOCOL_V2)
+    {
+        for (uint8_t i = 0; i < length; i++)
+            EasyCon_serial_send(data[i]);
+        return true;
+    }
+    n = EasyCon_frame_build(frame, seq, cmd, 0, data, length);
+    return EasyCon_serial_send_frame(frame, n);
+}
+
+#if REPORT_TRACE_LENGTH > 0 || EXEC_TRACE_LENGTH > 0 || LAP_LOG_LENGTH > 0
+// Hand a trace or lap reply of length bytes to main loop, header counts are already taken.
+static void EasyCon_dump_start(uint8_t cmd, uint16_t length)
+{
+    dump_seq = frame_seq;
+    dump_index = 0;
+    dump_length = length;
+    reply_deferred = protocol == PROTOCOL_V2;
+    dump_cmd = cmd;
+}
+
+// Read byte i of the dump being sent, layout as replied by CMD_TRACE, CMD_EXECTRACE and CMD_LAPS.
+static uint8_t EasyCon_dump_byte(uint16_t i)
+{
+#if LAP_LOG_LENGTH > 0
+    if (dump_cmd == CMD_LAPS)
+    {
+        uint16_t count = dump_header[0] | (dump_header[1] << 8);
+        uint16_t kept = Min(count, LAP_LOG_LENGTH);
+        lap_t *e;
+        if (i < 2)
+            return dump_header[i];
+        i -= 2;
+        e = &mem.lap[(mem.lap_head - kept + i / 5) & (LAP_LOG_LENGTH - 1)];
+        i %= 5;
+        return i == 0 ? e->tag : e->time >> ((i - 1) << 3);
+    }
+#endif
+#if REPORT_TRACE_LENGTH > 0
+    if (dump_cmd == CMD_TRACE)
+    {
+        trace_event_t *e;
+        if (i < 2)
+            return dump_header[i];
+        i -= 2;
+        e = &mem.trace[i / (2 + TRACE_REPORT_SIZE)];
+        i %= 2 + TRACE_REPORT_SIZE;
+        return i < 2 ? e->time >> (i << 3) : e->report[i - 2];
+    }
+#endif
+#if EXEC_TRACE_LENGTH > 0
+    {
+        uint16_t kept = dump_header[0] | (dump_header[1] << 8);
+        uint8_t k = Min(mem.exec.reports, EXEC_TRACE_REPORTS);
+        if (i < 4)
+            return dump_header[i];
+        i -= 4;
+        if (i < kept * 3)
+        {
+            exec_entry_t *e = &mem.exec.entry[(mem.exec.head - kept + i / 3) & (EXEC_TRACE_LENGTH - 1)];
+            i %= 3;
+            return i < 2 ? e->word >> (i << 3) : e->dt;
+        }
+        i -= kept * 3;
+        if (i == 0)
+            return k;
+        i--;
+        return mem.exec.report[(mem.exec.reports - k + i / TRACE_REPORT_SIZE) & (EXEC_TRACE_REPORTS - 1)][i % TRACE_REPORT_SIZE];
+    }
+#else
+    return 0;
+#endif
+}
+#endif
+
+// Send next piece of a requested trace or lap log when serial queue has room.
+void EasyCon_dump_task(void)
+{
+#if REPORT_TRACE_LENGTH > 0 || EXEC_TRACE_LENGTH > 0 || LAP_LOG_LENGTH > 0
+    uint8_t data[FRAME_CHUNK];
+    uint8_t frame[FRAME_CHUNK + 6];
+    uint8_t length, n;
+    if (dump_cmd == 0)
+        return;
+    length = Min(dump_length - dump_index, FRAME_CHUNK);
+    for (uint8_t i = 0; i < length; i++)
+        data[i] = EasyCon_dump_byte(dump_index + i);
+    if (protocol == PROTOCOL_V2)
+    {
+        n = EasyCon_frame_build(frame, dump_seq, dump_cmd, dump_index + length < dump_length ? FRAME_MORE : 0, data, length);
+        if (!EasyCon_serial_send_frame(frame, n))
+            return;
+    }
+    else if (!EasyCon_serial_send_frame(data, length))
+        return;
+    dump_index += length;
+    if (dump_index == dump_length)
+        dump_cmd = 0;
+#endif
+}
+
+// Apply a report from host, return the reply.
+static uint8_t EasyCon_serial_report(uint16_t button, uint8_t hat, uint8_t lx, uint8_t ly, uint8_t rx, uint8_t ry)
+{
+    if (_script_running && mix_enabled)
+    {
+        // merged with script report when sent
+        SetOverlay(button, hat, lx, ly, rx, ry);
+        _report_echo = echo_times;
+        return REPLY_ACK;
+    }
+    if (_script_running)
+    {
+        // script running, send BUSY
+        return REPLY_BUSY;
+    }
+    SetReport(button, hat, lx, ly, rx, ry);
+    if (recording)
+        EasyCon_record_frame(button, hat, lx, ly, rx, ry);
+    // set flag
+    _report_echo = echo_times;
+    return REPLY_ACK;
+}
+
+// Take a byte of flashing, true once all of them are received.
+static bool EasyCon_flash_store(uint8_t byte)
+{
+#if HOT_SWAP
+    if (stage_image != STAGE_NONE)
+    {
+        // staging, written in background while script keeps running
+        stage_buffer[flash_index++] = byte;
+        return flash_index == flash_count;
+    }
+#endif
+    FLASH_BUFFER(flash_index) = byte;
+    flash_index++;
+    return flash_index == flash_count;
+}
+
+// Write received flashing bytes.
+static void EasyCon_flash_commit(void)
+{
+#if HOT_SWAP
+    if (stage_image != STAGE_NONE)
+    {
+        stage_addr = flash_addr;
+        stage_index = 0;
+        stage_reply = true;
+        stage_seq = frame_seq;
+        stage_count = flash_count;
+        flash_count = 0;
+        flash_index = 0;
+        return;
+    }
+#endif
+    image_state = IMAGE_UNCHECKED;
+    EasyCon_update_block(flash_addr, &FLASH_BUFFER(0), flash_count);
+    flash_addr += flash_count;
+    flash_count = 0;
+    flash_index = 0;
+    EasyCon_serial_reply(REPLY_FLASHEND);
+}
+
+// Run a command, parameters are in serial buffer.
+static void EasyCon_serial_command(uint8_t cmd, uint8_t length)
+{
+    int16_t value;
+    switch (cmd)
+    {
+    case CMD_DEBUG:;
+        uint32_t n;
+        // instruction count
+        //uint8_t* count = (uint8_t*)(eeprom_read_byte((uint8_t*)0) | (eeprom_read_byte((uint8_t*)1) << 8));
+        //for (uint8_t* i = 0; i < count; i++)
+        //EasyCon_serial_reply(eeprom_read_byte(i));
+
+        // current loop variable, none while VM memory holds recorded code
+        n = !recording && mem.u.s.vm.ctx.forstackindex ? FOR_I(mem.u.s.vm.ctx.forstackindex - 1) : 0;
+        for (int i = 0; i < 4; i++)
+        {
+            EasyCon_serial_reply(n);
+            n >>= 8;
+        }
+
+        // time elapsed
+        n = timer_elapsed;
+        for (int i = 0; i < 4; i++)
+        {
+            EasyCon_serial_reply(n);
+            n >>= 8;
+        }
+
+        // PC
+        n = (uint16_t)script_addr;
+        for (int i = 0; i < 2; i++)
+        {
+            EasyCon_serial_reply(n);
+            n >>= 8;
+        }
+        break;
+    case CMD_VERSION:
+        // optional parameter switches protocol, after replying in the current one
+        EasyCon_serial_reply(VERSION);
+        if (length == 1 && (SERIAL_BUFFER(0) == PROTOCOL_V1 || SERIAL_BUFFER(0) == PROTOCOL_V2))
+        {
+            protocol = SERIAL_BUFFER(0);
+            frame_state = FRAME_IDLE;
+        }
+        break;
+    case CMD_BOOTTIME:
+        EasyCon_serial_reply(boot_ms);
+        EasyCon_serial_reply(boot_ms >> 8);
+        break;
+    case CMD_LED:
+        _ledflag ^= 0x8;
+        EasyCon_write_byte((uint8_t *)LED_SETTING, _ledflag);
+        EasyCon_runningLED_off();
+        EasyCon_serial_reply(_ledflag);
+        break;
+    case CMD_READY:
+        serial_command_ready = true;
+        break;
+    case CMD_HELLO:
+        EasyCon_serial_reply(REPLY_HELLO);
+        break;
+    case CMD_FLASH:
+        if (length != 4)
+        {
+            EasyCon_serial_reply(REPLY_ERROR);
+            break;
+        }
+        if (recording)
+        {
+            EasyCon_serial_reply(REPLY_BUSY);
+            break;
+        }
+#if HOT_SWAP
+        if (stage_image != STAGE_NONE)
+        {
+            // address is relative to staged image, script keeps running
+            if (stage_count != 0 || swap_pending)
+            {
+                EasyCon_serial_reply(REPLY_BUSY);
+                break;
+            }
+            flash_addr = (uint8_t *)serial_param16(0);
+            flash_count = serial_param16(2);
+            flash_index = 0;
+            if (flash_count > STAGE_BUFFER_SIZE || (uint16_t)flash_addr + flash_count > MEM_SIZE)
+            {
+                flash_count = 0;
+                EasyCon_serial_reply(REPLY_ERROR);
+                break;
+            }
+            flash_addr += IMAGE_BASE(stage_image);
+            EasyCon_serial_reply(REPLY_FLASHSTART);
+            break;
+        }
+#endif
+        EasyCon_script_stop();
+        // address is relative to the image of active slot
+        flash_addr = (uint8_t *)serial_param16(0);
+        flash_count = serial_param16(2);
+        flash_index = 0;
+        if (flash_count > FLASH_BUFFER_SIZE || (uint16_t)flash_addr + flash_count > MEM_SIZE)
+        {
+            // larger than buffer or image, would overrun variables or settings
+            flash_count = 0;
+            EasyCon_serial_reply(REPLY_ERROR);
+            break;
+        }
+        flash_addr += (uint16_t)script_base;
+        EasyCon_serial_reply(REPLY_FLASHSTART);
+        break;
+    case CMD_SLOT:
+        if (length == 0)
+        {
+            // query active slot
+            EasyCon_serial_reply(script_slot);
+        }
+        else if (length == 1)
+        {
+            // select slot
+            EasyCon_serial_reply(EasyCon_script_select(SERIAL_BUFFER(0)) ? REPLY_ACK : REPLY_ERROR);
+        }
+        else if (length == 4 && SERIAL_BUFFER(0) < SCRIPT_SLOTS && SERIAL_BUFFER(1) < SCRIPT_IMAGES &&
+                 serial_param16(2) == SLOT_ENTRY(serial_param16(2)))
+        {
+            // write directory entry: slot, image, entry address
+            EasyCon_write_2byte((uint16_t *)(SLOT_DIRECTORY + (SERIAL_BUFFER(0) << 1)),
+                                (SERIAL_BUFFER(1) << 13) | serial_param16(2));
+            if (SERIAL_BUFFER(0) == script_slot)
+                EasyCon_script_select(script_slot);
+            EasyCon_serial_reply(REPLY_ACK);
+        }
+        else
+        {
+            EasyCon_serial_reply(REPLY_ERROR);
+        }
+        break;
+    case CMD_REPORT:
+        // set policy, and optionally interval and echo times; reply current values
+        // settings are stored next to each other, only changed bytes are written
+        if (length == 1 || length == 3)
+            EasyCon_update_block((uint8_t *)REPORT_SETTING, &SERIAL_BUFFER(0), length);
+        EasyCon_report_load();
+        EasyCon_serial_reply(report_setting);
+        EasyCon_serial_reply(report_interval);
+        EasyCon_serial_reply(echo_times);
+        break;
+    case CMD_MIX:
+        // enable or disable overlay of report frames while running, reply mode
+        if (length == 1)
+        {
+            mix_enabled = SERIAL_BUFFER(0) != 0;
+            if (!mix_enabled)
+            {
+                ClearOverlay();
+                _report_echo = echo_times;
+            }
+        }
+        EasyCon_serial_reply(mix_enabled);
+        break;
+    case CMD_SETREG:
+        // register index, value in 7+7+2 bits (v2: 16 bits); applied between instructions,
+        // or before the first one of next run if stopped
+        if (length != (protocol == PROTOCOL_V2 ? 3 : 4) || SERIAL_BUFFER(0) >= REGISTER_COUNT)
+        {
+            EasyCon_serial_reply(REPLY_ERROR);
+            break;
+        }
+        value = protocol == PROTOCOL_V2 ? serial_param16(1) : SERIAL_BUFFER(1) | (SERIAL_BUFFER(2) << 7) | (SERIAL_BUFFER(3) << 14);
+        // registers share memory with the recording
+        if (recording || inject_reg != REGISTER_NONE)
+        {
+            EasyCon_serial_reply(REPLY_BUSY);
+            break;
+        }
+        inject_value = value;
+        inject_reg = SERIAL_BUFFER(0);
+        EasyCon_serial_reply(REPLY_ACK);
+        break;
+    case CMD_GETREG:
+        // value of one register, or of all registers without index, 2 bytes each
+        if (recording)
+            EasyCon_serial_reply(REPLY_BUSY);
+        else if (length == 1 && SERIAL_BUFFER(0) < REGISTER_COUNT)
+        {
+            EasyCon_serial_reply(REG(SERIAL_BUFFER(0)));
+            EasyCon_serial_reply(REG(SERIAL_BUFFER(0)) >> 8);
+        }
+        else if (length == 0)
+        {
+            for (uint8_t i = 0; i < REGISTER_COUNT; i++)
+            {
+                EasyCon_serial_reply(REG(i));
+                EasyCon_serial_reply(REG(i) >> 8);
+            }
+        }
+        else
+            EasyCon_serial_reply(REPLY_ERROR);
+        break;
+    case CMD_RECORD:
+        // 1 starts recording report frames, 0 saves them to active image and replies length (2 bytes) and truncated
+        if (length == 1 && SERIAL_BUFFER(0) == 1)
+        {
+            EasyCon_record_start();
+            EasyCon_serial_reply(REPLY_ACK);
+        }
+        else if (length == 1 && SERIAL_BUFFER(0) == 0 && recording)
+        {
+            EasyCon_record_save();
+            EasyCon_serial_reply(2 + record_length);
+            EasyCon_serial_reply((2 + record_length) >> 8);
+            EasyCon_serial_reply(record_truncated);
+        }
+        else
+            EasyCon_serial_reply(REPLY_ERROR);
+        break;
+    case CMD_LAPS:
+        // markers reached (2 bytes), then kept ones oldest first: tag, ms since start (4 bytes)
+#if LAP_LOG_LENGTH > 0
+        if (dump_cmd != 0)
+        {
+            EasyCon_serial_reply(REPLY_BUSY);
+            break;
+        }
+        dump_header[0] = mem.lap_count;
+        dump_header[1] = mem.lap_count >> 8;
+        EasyCon_dump_start(CMD_LAPS, 2 + Min(mem.lap_count, LAP_LOG_LENGTH) * 5);
+#else
+        EasyCon_serial_reply(REPLY_ERROR);
+#endif
+        break;
+    case CMD_TRACE:
+        // report changes of last run: count, lost, then time (2 bytes) and report of each
+#if REPORT_TRACE_LENGTH > 0
+        if (dump_cmd != 0)
+        {
+            EasyCon_serial_reply(REPLY_BUSY);
+            break;
+        }
+        dump_header[0] = mem.trace_count;
+        dump_header[1] = mem.trace_lost;
+        EasyCon_dump_start(CMD_TRACE, 2 + mem.trace_count * (2 + TRACE_REPORT_SIZE));
+#else
+        EasyCon_serial_reply(REPLY_ERROR);
+#endif
+        break;
+    case CMD_EXECTRACE:
+        // entries kept (2 bytes), ms since newest (2 bytes), entries oldest first (address or report mark, dt),
+        // then report changes kept (1 byte) and their bytes, oldest first
+#if EXEC_TRACE_LENGTH > 0
+    {
+        uint16_t kept = Min(mem.exec.count, EXEC_TRACE_LENGTH);
+        uint16_t age = exec_clock - mem.exec.time;
+        if (dump_cmd != 0)
+        {
+            EasyCon_serial_reply(REPLY_BUSY);
+            break;
+        }
+        dump_header[0] = kept;
+        dump_header[1] = kept >> 8;
+        dump_header[2] = age;
+        dump_header[3] = age >> 8;
+        EasyCon_dump_start(CMD_EXECTRACE, 4 + kept * 3 + 1 + Min(mem.exec.reports, EXEC_TRACE_REPORTS) * TRACE_REPORT_SIZE);
+        break;
+    }
+#else
+        EasyCon_serial_reply(REPLY_ERROR);
+        break;
+#endif
+    case CMD_STAGE:
+        // route following CMD_FLASH to partner of active image, reply its number
+#if HOT_SWAP
+        if (swap_pending || stage_count != 0)
+        {
+            EasyCon_serial_reply(REPLY_BUSY);
+            break;
+        }
+        if ((active_image ^ 1) < SCRIPT_IMAGES)
+        {
+            stage_image = active_image ^ 1;
+            EasyCon_serial_reply(stage_image);
+            break;
+        }
+#endif
+        EasyCon_serial_reply(REPLY_ERROR);
+        break;
+    case CMD_COMMIT:
+        // switch to staged image once its writes are done, from main loop at next instruction boundary
+#if HOT_SWAP
+        if (stage_image != STAGE_NONE && stage_count == 0 && flash_count == 0)
+        {
+            uint16_t eof = EasyCon_read_2byte((uint16_t *)IMAGE_BASE(stage_image)) & 0x7FFF;
+#if COMPRESSED_SCRIPT
+            // logical size of compressed image may exceed the image
+            if (eof & COMPRESSED_FLAG)
+                eof = Min((eof & ~COMPRESSED_FLAG), MEM_SIZE);
+#endif
+            if (eof >= 2 && eof <= MEM_SIZE)
+            {
+                swap_pending = true;
+                EasyCon_serial_reply(REPLY_ACK);
+                break;
+            }
+        }
+#endif
+        EasyCon_serial_reply(REPLY_ERROR);
+        break;
+    case CMD_TELEMETRY:
+        // interval in ms (2 x 7 bits), 0 to stop
+#if TELEMETRY
+        if (length == 2)
+        {
+            telemetry_interval = serial_param16(0);
+            telemetry_ms = 0;
+            EasyCon_serial_reply(REPLY_ACK);
+            break;
+        }
+#endif
+        EasyCon_serial_reply(REPLY_ERROR);
+        break;
+    case CMD_SCRIPTSTART:
+        if (recording)
+        {
+            EasyCon_serial_reply(REPLY_BUSY);
+            break;
+        }
+        EasyCon_script_request_start();
+        EasyCon_serial_reply(REPLY_SCRIPTACK);
+        break;
+    case CMD_SCRIPTSTOP:
+        EasyCon_script_stop();
+        EasyCon_serial_reply(REPLY_SCRIPTACK);
+        break;
+#ifdef EASYCON_BENCH
+    case CMD_BENCH:
+        Bench_Run(length == 0 ? BENCH_KERNELS : SERIAL_BUFFER(0));
+        break;
+#endif
+    default:
+        // error
+        EasyCon_serial_reply(REPLY_ERROR);
+        break;
+    }
+}
+
+// Receive v2 frames, and flash data following CMD_FLASH.
+static void EasyCon_frame_task(uint8_t byte)
+{
+    switch (frame_state)
+    {
+    case FRAME_IDLE:
+        if (byte == FRAME_SYNC)
+        {
+            frame_crc = FRAME_CRC_INIT;
+            frame_state = FRAME_LENGTH;
+        }
+        else if (byte == CMD_HELLO && frame_last == CMD_READY)
+        {
+            // v1 host took over
+            protocol = PROTOCOL_V1;
+            serial_buffer_length = 0;
+            serial_command_ready = false;
+            EasyCon_serial_send(REPLY_HELLO);
+        }
+        frame_last = byte;
+        return;
+    case FRAME_LENGTH:
+        frame_length = byte;
+        frame_index = 0;
+        frame_state = FRAME_SEQ;
+        break;
+    case FRAME_SEQ:
+        frame_seq = byte;
+        frame_state = FRAME_CMD;
+        break;
+    case FRAME_CMD:
+        frame_cmd = byte;
+        frame_state = frame_length == 0 ? FRAME_CRC_LO : FRAME_PAYLOAD;
+        break;
+    case FRAME_PAYLOAD:
+        // longer payload is received but rejected
+        if (frame_index < SERIAL_BUFFER_SIZE)
+            SERIAL_BUFFER(frame_index) = byte;
+        if (++frame_index == frame_length)
+            frame_state = FRAME_CRC_LO;
+        break;
+    case FRAME_CRC_LO:
+    case FRAME_DATA_CRC_LO:
+        frame_crc ^= byte;
+        frame_state++;
+        return;
+    case FRAME_CRC_HI:
+        frame_crc ^= byte << 8;
+        frame_state = FRAME_IDLE;
+        frame_last = byte;
+        if (frame_crc != 0 || frame_length > SERIAL_BUFFER_SIZE)
+        {
+            frame_cmd = FRAME_NAK;
+            EasyCon_reply_flush(0);
+            return;
+        }
+        if (frame_cmd == FRAME_REPORT)
+        {
+            if (frame_length == 7)
+                EasyCon_serial_reply(EasyCon_serial_report(SERIAL_BUFFER(0) | (SERIAL_BUFFER(1) << 8), SERIAL_BUFFER(2),
+                                                           SERIAL_BUFFER(3), SERIAL_BUFFER(4), SERIAL_BUFFER(5), SERIAL_BUFFER(6)));
+            else
+                EasyCon_serial_reply(REPLY_ERROR);
+        }
+        else
+            EasyCon_serial_command(frame_cmd, frame_length);
+#if REPORT_TRACE_LENGTH > 0 || EXEC_TRACE_LENGTH > 0 || LAP_LOG_LENGTH > 0
+        if (reply_deferred)
+            reply_deferred = false;
+        else
+#endif
+            EasyCon_reply_flush(0);
+        if (flash_index < flash_count && protocol == PROTOCOL_V2)
+        {
+            frame_crc = FRAME_CRC_INIT;
+            frame_state = FRAME_DATA;
+        }
+        return;
+    case FRAME_DATA:
+        if (EasyCon_flash_store(byte))
+            frame_state = FRAME_DATA_CRC_LO;
+        break;
+    case FRAME_DATA_CRC_HI:
+        frame_crc ^= byte << 8;
+        frame_state = FRAME_IDLE;
+        frame_last = byte;
+        if (frame_crc != 0)
+        {
+            // drop, nothing is written
+            flash_count = 0;
+            flash_index = 0;
+            frame_cmd = FRAME_NAK;
+            EasyCon_reply_flush(0);
+            return;
+        }
+        EasyCon_flash_commit();
+        if (reply_length != 0)
+            EasyCon_reply_flush(0);
+        return;
+    }
+    frame_crc = EasyCon_crc16_update(frame_crc, byte);
+}
+
+// Process data from serial port.
+void EasyCon_serial_task(int16_t byte)
+{
+    if (byte < 0)
+        return;
+    if(_ledflag == 0)
+        EasyCon_blink_led();
+    if (serial_idle_ms >= SERIAL_TIMEOUT_MS)
+    {
+        // sender went away in the middle, resync on this byte
+        serial_buffer_length = 0;
+        serial_command_ready = false;
+        frame_state = FRAME_IDLE;
+        if (flash_index < flash_count)
+        {
+            // drop unfinished flashing, nothing is written yet
+            flash_count = 0;
+            flash_index = 0;
+        }
+    }
+    serial_idle_ms = 0;
+    if (protocol == PROTOCOL_V2)
+    {
+        EasyCon_frame_task(byte);
+        return;
+    }
+    if (flash_index < flash_count)
+    {
+        // flashing
+        if (EasyCon_flash_store(byte))
+            EasyCon_flash_commit();
+    }
+    else
+    {
+        // regular
+        SERIAL_BUFFER(serial_buffer_length++) = byte;
+        // check control byte
+        if ((byte & 0x80) != 0)
+        {
+            if (serial_buffer_length == 1 && !serial_command_ready && byte == CMD_READY)
+            {
+                // comand ready
+                serial_command_ready = true;
+            }
+            else if (serial_buffer_length == 8)
+            {
+                // report data
+                uint16_t button = (SERIAL_BUFFER(0) << 9) | (SERIAL_BUFFER(1) << 2) | (SERIAL_BUFFER(2) >> 5);
+                uint8_t hat = (uint8_t)((SERIAL_BUFFER(2) << 3) | (SERIAL_BUFFER(3) >> 4));
+                uint8_t lx = (uint8_t)((SERIAL_BUFFER(3) << 4) | (SERIAL_BUFFER(4) >> 3));
+                uint8_t ly = (uint8_t)((SERIAL_BUFFER(4) << 5) | (SERIAL_BUFFER(5) >> 2));
+                uint8_t rx = (uint8_t)((SERIAL_BUFFER(5) << 6) | (SERIAL_BUFFER(6) >> 1));
+                uint8_t ry = (uint8_t)((SERIAL_BUFFER(6) << 7) | (SERIAL_BUFFER(7) & 0x7f));
+                EasyCon_serial_send(EasyCon_serial_report(button, hat, lx, ly, rx, ry));
+                serial_command_ready = false;
+            }
+            else if (serial_command_ready)
+            {
+                serial_command_ready = false;
+                // command
+                EasyCon_serial_command(byte, serial_buffer_length - 1);
             }
             else
             {
@@ -17,17 +17,67 @@
 
 // constants
 #define SERIAL_BUFFER_SIZE 20
-#define DIRECTION_OFFSET 20
-#define VARSPACE_OFFSET 90
-#define KEYCODE_OFFSET 90
+#define SERIAL_TIMEOUT_MS 500 // gap that drops a partial frame or unfinished flashing
 #define KEYCODE_MAX 33
-#define REGISTER_OFFSET 130
-#define STACK_OFFSET 150
-#define CALLSTACK_OFFSET 190
-#define FORSTACK_OFFSET 250
-#define INS_OFFSET 370
+#define REGISTER_COUNT 16 // iterator registers are indexed by 4 bits
+#define REGISTER_NONE 0xFF
 #define SEED_OFFSET MEM_SIZE + 0
 #define LED_SETTING MEM_SIZE + 2
+#define SLOT_SETTING MEM_SIZE + 3
+#define SLOT_DIRECTORY MEM_SIZE + 4
+#define SEED_JOURNAL (MEM_SIZE + 20)
+#define REPORT_SETTING MEM_SIZE + 36
+#define REPORT_INTERVAL MEM_SIZE + 37
+#define REPORT_ECHO MEM_SIZE + 38
+#define SETTINGS_SIZE 64
+
+// seed journal: consecutive seeds written round robin, the newest is followed by a break in sequence
+#define SEED_JOURNAL_LENGTH 8
+
+// report setting: bit 0 for SOF alignment, bits 1~2 for rate policy
+#define REPORT_SOF 0x01 // send at most one report per USB frame, right after SOF with USB_INTERRUPT
+#define REPORT_POLICY(setting) (((setting) >> 1) & 0b11)
+#define POLICY_FIXED 0     // one report per interval
+#define POLICY_MAX 1       // report whenever the host polls
+#define POLICY_KEEPALIVE 2 // report per interval while changing, otherwise per KEEPALIVE_MS
+#define POLICY_ADAPTIVE 3  // report whenever polled while changing, back off to KEEPALIVE_MS while idle
+#define KEEPALIVE_MS 100
+
+// script slots: each directory entry holds (image << 13 | entry address), 0xFFFF is empty
+#define SCRIPT_SLOTS 8
+#define SLOT_IMAGE(entry) ((entry) >> 13)
+#define SLOT_ENTRY(entry) ((entry) & ((1 << 13) - 1))
+#define IMAGE_BASE(image) ((image) == 0 ? 0 : MEM_SIZE + SETTINGS_SIZE + ((image) - 1) * MEM_SIZE)
+
+// compressed image: eof has COMPRESSED_FLAG, followed by dictionary size, block index and dictionary
+// eof and all addresses are logical, each block of BLOCK_SIZE logical bytes is decoded on its own
+// block index holds the 2 byte image offset of each block, dictionary entries are instruction pairs
+// tools/compress_script.py is the reference encoder
+#define COMPRESSED_FLAG 0x4000
+#define BLOCK_SIZE 64
+#define BLOCK_INDEX 3
+#define BLOCK_NONE 0xFFFF
+#define DICT_ENTRY 4
+#define TOKEN_LITERAL 0x00 // 00nnnnnn: n + 1 literal words follow
+#define TOKEN_REPEAT 0x40  // 01nnnnnn iiiiiiii: dictionary entry i, n + 2 times
+#define TOKEN_ENTRY 0x80   // 1iiiiiii: dictionary entry i
+
+// A/B update: images 2n and 2n+1 are partners, the inactive one is flashed while the other runs
+#define HOT_SWAP (SCRIPT_IMAGES >= 2 && STAGE_BUFFER_SIZE > 0)
+#define STAGE_NONE 0xFF
+
+// register area of the old fixed layout, still addressed by SerialPrint
+#define LEGACY_REGISTER_OFFSET 130
+
+// stack depths come from binfos.h, indexes are single bytes
+#if STACK_DEPTH > 255 || CALLSTACK_DEPTH > 255 || FORSTACK_DEPTH > 127
+#error "VM stack depth out of range"
+#endif
+
+// script image verification state
+#define IMAGE_UNCHECKED 0
+#define IMAGE_VERIFIED 1
+#define IMAGE_UNVERIFIED 2
 
 // serial protocal control bytes and replies
 #define CMD_READY 0xA5
@@ -38,6 +88,20 @@
 #define CMD_SCRIPTSTOP 0x84
 #define CMD_VERSION 0x85
 #define CMD_LED 0x86
+#define CMD_SLOT 0x87
+#define CMD_BENCH 0x88 // only with EASYCON_BENCH
+#define CMD_BOOTTIME 0x89
+#define CMD_REPORT 0x8A
+#define CMD_TRACE 0x8B
+#define CMD_TELEMETRY 0x8C
+#define CMD_EXECTRACE 0x8D
+#define CMD_STAGE 0x8E
+#define CMD_COMMIT 0x8F
+#define CMD_SETREG 0x90
+#define CMD_GETREG 0x91
+#define CMD_MIX 0x92
+#define CMD_LAPS 0x93
+#define CMD_RECORD 0x94
 #define REPLY_ERROR 0x00
 #define REPLY_ACK 0xFF
 #define REPLY_BUSY 0xFE
@@ -46,49 +110,299 @@
 #define REPLY_FLASHEND 0x82
 #define REPLY_SCRIPTACK 0x83
 
+// serial protocol v2, entered by CMD_VERSION with parameter 2, left by parameter 1 or the v1 READY, HELLO
+// frame: sync, length, sequence, command, payload, CRC-16 of length to payload (little-endian)
+// payload bytes are 8 bits, 16-bit parameters are little-endian instead of 7-bit pairs
+// replies echo sequence and command, long replies span frames with FRAME_MORE set in length
+// flashing: CMD_FLASH (address, count) is followed by count data bytes and their CRC, not framed
+// bench results stay unframed, followed by an empty reply
+// telemetry records are CMD_TELEMETRY frames, sequence echoes the record, payload is the record without sync and sum
+#define PROTOCOL_V1 1
+#define PROTOCOL_V2 2
+#define FRAME_SYNC 0xA7
+#define FRAME_MORE 0x80
+#define FRAME_CHUNK 16     // reply bytes per frame
+#define FRAME_CRC_INIT 0xFFFF
+#define FRAME_REPORT 0x00  // host report: buttons (2), HAT, LX, LY, RX, RY
+#define FRAME_PRINT 0x01   // SerialPrint output of script
+#define FRAME_NAK 0x02     // frame or flash data failed CRC, nothing done
+#if FRAME_CHUNK + 6 >= SERIAL_TX_SIZE
+#error "SERIAL_TX_SIZE too small for a reply frame"
+#endif
+
+// frame receiving state
+#define FRAME_IDLE 0
+#define FRAME_LENGTH 1
+#define FRAME_SEQ 2
+#define FRAME_CMD 3
+#define FRAME_PAYLOAD 4
+#define FRAME_CRC_LO 5
+#define FRAME_CRC_HI 6
+#define FRAME_DATA 7
+#define FRAME_DATA_CRC_LO 8
+#define FRAME_DATA_CRC_HI 9
+
+// report bytes kept in traces: buttons, HAT and sticks
+#define TRACE_REPORT_SIZE 7
+
+#if REPORT_TRACE_LENGTH > 0
+// report change, as sent to host
+typedef struct
+{
+    uint16_t time; // ms since script start, wraps every 65536 ms
+    uint8_t report[TRACE_REPORT_SIZE];
+} trace_event_t;
+#endif
+
+#if EXEC_TRACE_LENGTH > 0
+#if (EXEC_TRACE_LENGTH & (EXEC_TRACE_LENGTH - 1)) != 0 || EXEC_TRACE_LENGTH > 256 || \
+    (EXEC_TRACE_REPORTS & (EXEC_TRACE_REPORTS - 1)) != 0 || EXEC_TRACE_REPORTS == 0
+#error "EXEC_TRACE_LENGTH and EXEC_TRACE_REPORTS must be powers of two, up to 256 entries"
+#endif
+#define EXEC_TRACE_REPORT 0x8000 // entry is a report change, low bits count report changes
+
+// executed instruction or report change
+typedef struct
+{
+    uint16_t word; // instruction address, or EXEC_TRACE_REPORT | report change number
+    uint8_t dt;    // ms since previous entry, 255 for longer
+} exec_entry_t;
+
+// instruction trace, kept until next script start
+typedef struct
+{
+    exec_entry_t entry[EXEC_TRACE_LENGTH];
+    uint8_t report[EXEC_TRACE_REPORTS][TRACE_REPORT_SIZE]; // indexed by report change number
+    uint8_t last[TRACE_REPORT_SIZE];                       // last report sent
+    uint16_t count;                                        // entries ever written, saturating
+    uint16_t reports;                                      // report changes ever written
+    uint16_t time;                                         // clock of newest entry
+    uint8_t head;                                          // next entry to write
+} exec_trace_t;
+
+#define EXEC_TRACE(word) EasyCon_exec_trace(word)
+#else
+#define EXEC_TRACE(word)
+#endif
+
+// telemetry record: sync, seq, PC (2), timer_ms (4), loop counter (4), R0~R7 (16), report (7), sum
+// multi-byte fields are little-endian, sum is the low byte of the sum of all bytes before it
+#define TELEMETRY_SYNC 0xA6
+#define TELEMETRY_REGISTERS 8
+#define TELEMETRY_SIZE (2 + 2 + 4 + 4 + TELEMETRY_REGISTERS * 2 + 7 + 1)
+#define TELEMETRY (SERIAL_TX_SIZE >= TELEMETRY_SIZE + 4) // v2 frame of the record fits in queue
+
+#if LAP_LOG_LENGTH > 0
+#if (LAP_LOG_LENGTH & (LAP_LOG_LENGTH - 1)) != 0 || LAP_LOG_LENGTH > 256
+#error "LAP_LOG_LENGTH must be a power of two, up to 256 entries"
+#endif
+// Lap marker reached
+typedef struct
+{
+    uint8_t tag;
+    uint32_t time; // ms since script start
+} lap_t;
+#endif
+
+// loop stack entry
+typedef struct
+{
+    union
+    {
+        int32_t l;  // loop variable, or iterator register index with highest bit set
+        uint16_t w; // loop variable of 16-bit loop
+    } var;
+    union
+    {
+        int32_t l;  // loop count, 0x80000000 for infinite loop
+        uint16_t w; // loop count of 16-bit loop, 0 for infinite loop
+    } count;
+    uint16_t addr; // address of For, or of loop body with FOR_SHORT set
+    uint16_t next; // address of Next
+} for_frame_t;
+
+// 16-bit loop set up by ForCount, Next jumps straight back to its body
+#define FOR_SHORT 0x8000
+
+// instruction carrier, bytes are kept in the order they are combined
+typedef union
+{
+    uint32_t ex;  // extended instruction
+    uint16_t w[2];
+    uint8_t b[4]; // _ins3, _ins2, _ins1, _ins0
+} ins_t;
+
+#if STICK_MOTION
+// stick motion modes
+#define MOTION_NONE 0
+#define MOTION_RAMP 1
+#define MOTION_ARC 2
+#define MOTION_CIRCLE 3
+
+// stick trajectory, advanced every ms by EasyCon_tick
+typedef struct
+{
+    uint8_t mode;
+    uint8_t radius;     // rotation radius, 0~128
+    uint16_t remaining; // ms left for ramp and arc
+    union
+    {
+        struct
+        {
+            uint16_t x, y;  // position, 8.8 fixed point
+            int16_t dx, dy; // step per ms
+            uint8_t tx, ty; // target
+        } ramp;
+        struct
+        {
+            uint16_t phase; // angle in 1/65536 turn, 0 is up and clockwise
+            int16_t step;   // angle per ms
+            uint16_t end;   // final angle of arc
+        } rot;
+    } u;
+} motion_t;
+#endif
+
+// interpreter registers, held in locals while script task runs and saved in vm_t when it yields
+typedef struct
+{
+    ins_t ins;
+    uint16_t addr;  // address of current instruction
+    uint16_t e_val; // external argument for next instruction (used for dynamic for-loop, wait etc.)
+    uint8_t keycode;
+    uint8_t lr;
+    uint8_t direction;
+    uint8_t stackindex;
+    uint8_t callstackindex;
+    uint8_t forstackindex;
+    uint8_t e_set;
+    uint8_t e_set_t;
+    uint8_t ri0;
+    uint8_t ri1;
+    uint8_t v;
+    uint8_t flag;
+} vm_context_t;
+
+// script variables, cleared on script start
+typedef struct
+{
+    uint8_t key[KEYCODE_MAX + 1]; // release countdown of each key
+    int16_t reg[REGISTER_COUNT];
+    int16_t stack[STACK_DEPTH];
+    uint16_t callstack[CALLSTACK_DEPTH];
+    for_frame_t forstack[FORSTACK_DEPTH];
+    vm_context_t ctx; // saved interpreter registers
+#if STICK_MOTION
+    volatile motion_t motion[2]; // LS, RS, also written by the ms tick
+#endif
+} vm_t;
+
+// preallocated memory for all purposes
+typedef struct
+{
+    union
+    {
+        // flash data and recorded macro span the variables, script is stopped meanwhile
+        uint8_t flash_buffer[SERIAL_BUFFER_SIZE + sizeof(vm_t)];
+        struct
+        {
+            uint8_t serial_buffer[SERIAL_BUFFER_SIZE];
+            vm_t vm;
+        } s;
+    } u;
+    uint8_t script_running;
+    uint8_t report_echo;
+#if SCRIPT_CACHE_SIZE > 0
+    uint8_t cache[SCRIPT_CACHE_SIZE]; // copy of the head of script image
+#endif
+#if COMPRESSED_SCRIPT
+    uint8_t window[BLOCK_SIZE]; // decoded block of compressed image
+#endif
+#if REPORT_TRACE_LENGTH > 0
+    trace_event_t trace[REPORT_TRACE_LENGTH]; // report changes of last script run
+    uint8_t trace_count;
+    uint8_t trace_lost; // changes after trace was full
+    uint8_t trace_last[TRACE_REPORT_SIZE]; // last report sent
+#endif
+#if EXEC_TRACE_LENGTH > 0
+    exec_trace_t exec;
+#endif
+#if LAP_LOG_LENGTH > 0
+    lap_t lap[LAP_LOG_LENGTH]; // ring of newest markers
+    uint16_t lap_count;        // markers reached this run, saturating
+    uint8_t lap_head;          // next entry to write
+#endif
+} mem_t;
+
+#define FLASH_BUFFER_SIZE sizeof(mem.u.flash_buffer)
+
+// macro recorder, serial buffer stays in use for incoming frames
+#define RECORD_BUFFER(i) ((uint8_t *)&mem.u.s.vm)[(i)]
+#define RECORD_BUFFER_SIZE Min(sizeof(vm_t), MEM_SIZE - 2)
+#define RECORD_DEADZONE 32 // stick offset recorded as centered
+#define DIRECTION_NONE 0xFF
+
 // indexed variables and inline functions
-#define SERIAL_BUFFER(i) mem[(i)]
-#define KEY(keycode) mem[KEYCODE_OFFSET + (keycode)]
-#define REG(i) *(int16_t *)(mem + REGISTER_OFFSET + ((i) << 1))
-#define STACK(i) *(int16_t *)(mem + STACK_OFFSET + ((i) << 1))
-#define CALLSTACK(i) *(uint16_t *)(mem + CALLSTACK_OFFSET + ((i) << 1))
-#define DX(i) mem[DIRECTION_OFFSET + ((i) << 1)]
-#define DY(i) mem[DIRECTION_OFFSET + ((i) << 1) + 1]
-#define FOR_I(i) *(int32_t *)(mem + FORSTACK_OFFSET + (i)*12)
-#define FOR_C(i) *(int32_t *)(mem + FORSTACK_OFFSET + (i)*12 + 4)
-#define FOR_ADDR(i) *(uint16_t *)(mem + FORSTACK_OFFSET + (i)*12 + 8)
-#define FOR_NEXT(i) *(uint16_t *)(mem + FORSTACK_OFFSET + (i)*12 + 10)
-#define SETWAIT(time) wait_ms = (time)
+#define SERIAL_BUFFER(i) mem.u.s.serial_buffer[(i)]
+#define FLASH_BUFFER(i) mem.u.flash_buffer[(i)]
+#define KEY(keycode) mem.u.s.vm.key[(keycode)]
+#define REG(i) mem.u.s.vm.reg[(i)]
+#define STACK(i) mem.u.s.vm.stack[(i)]
+#define CALLSTACK(i) mem.u.s.vm.callstack[(i)]
+#if STICK_MOTION
+#define MOTION(lr) mem.u.s.vm.motion[(lr)]
+#define MOTION_CANCEL(lr) MOTION(lr).mode = MOTION_NONE
+#else
+#define MOTION_CANCEL(lr)
+#endif
+#define DX(i) EasyCon_read_const_byte(&direction_table[(i)][0])
+#define DY(i) EasyCon_read_const_byte(&direction_table[(i)][1])
+#define FOR_I(n) mem.u.s.vm.forstack[(n)].var.l
+#define FOR_C(n) mem.u.s.vm.forstack[(n)].count.l
+#define FOR_I16(n) mem.u.s.vm.forstack[(n)].var.w
+#define FOR_C16(n) mem.u.s.vm.forstack[(n)].count.w
+#define FOR_ADDR(n) mem.u.s.vm.forstack[(n)].addr
+#define FOR_NEXT(n) mem.u.s.vm.forstack[(n)].next
+#define SETWAIT(time) ATOMIC_BLOCK(ATOMIC_RESTORESTATE) wait_ms = (time) // counter is decremented by timer interrupt
 #define RESETAFTER(keycode, n) KEY(keycode) = n
-#define JUMP(addr) script_addr = (uint8_t *)(addr)
-#define JUMPNEAR(addr) script_addr = (uint8_t *)((uint16_t)script_addr + (addr))
+#define JUMP(addr) pc = (addr)
+#define JUMPNEAR(addr) pc += (addr)
 #define E(val) _e_set = 1, _e_val = (val)
 #define E_SET ((_e_set_t = _e_set), (_e_set = 0), _e_set_t)
+#define GUARD(cond) if (!(cond)) { EasyCon_script_stop(); goto yield; } // runtime check, always performed
+#define CHECK(cond) if (image_state != IMAGE_VERIFIED) GUARD(cond)    // runtime check, skipped for verified image
+
+// verifier scratch, reuses the stacks before script starts
+#define VERIFY_TARGET(i) CALLSTACK(i) // pending forward branch target
+#define VERIFY_DEPTH(i) STACK(i)      // loop depth required at target, highest bit set for call
+#define VERIFY_NEXT(i) FOR_NEXT(i)    // address of Next for each open loop
+#define VERIFY_PENDING_MAX Min(STACK_DEPTH, CALLSTACK_DEPTH)
+
+// single variables
+#define _report_echo mem.report_echo
+#define _script_running mem.script_running
 
-// single-byte variables
-#define _ins3 mem[INS_OFFSET]
-#define _ins2 mem[INS_OFFSET + 1]
-#define _ins1 mem[INS_OFFSET + 2]
-#define _ins0 mem[INS_OFFSET + 3]
-#define _ins *(uint16_t *)(mem + INS_OFFSET + 2)
-#define _insEx *(uint32_t *)(mem + INS_OFFSET)
-#define _code mem[INS_OFFSET + 4]
-#define _keycode mem[INS_OFFSET + 5]
-#define _lr mem[INS_OFFSET + 6]
-#define _direction mem[INS_OFFSET + 7]
-#define _addr *(uint16_t *)(mem + INS_OFFSET + 8)
-#define _stackindex mem[INS_OFFSET + 10]
-#define _callstackindex mem[INS_OFFSET + 11]
-#define _forstackindex mem[INS_OFFSET + 12]
-#define _report_echo mem[INS_OFFSET + 13]
-#define _e_set mem[INS_OFFSET + 14]
-#define _e_set_t mem[INS_OFFSET + 15]
-#define _e_val *(uint16_t *)(mem + INS_OFFSET + 16) // external argument for next instruction (used for dynamic for-loop, wait etc.)
-#define _script_running mem[INS_OFFSET + 18]
-#define _ri0 mem[INS_OFFSET + 19]
-#define _ri1 mem[INS_OFFSET + 20]
-#define _v mem[INS_OFFSET + 21]
-#define _flag mem[INS_OFFSET + 22]
-#define _seed *(uint16_t *)(mem + INS_OFFSET + 23)
+// interpreter registers, only inside script task
+#define _ins3 ctx.ins.b[0]
+#define _ins2 ctx.ins.b[1]
+#define _ins1 ctx.ins.b[2]
+#define _ins0 ctx.ins.b[3]
+#define _ins ctx.ins.w[1]
+#define _insArg ctx.ins.w[0] // _ins2, _ins3 of extended instruction
+#define _insEx ctx.ins.ex
+#define _keycode ctx.keycode
+#define _lr ctx.lr
+#define _direction ctx.direction
+#define _addr ctx.addr
+#define _stackindex ctx.stackindex
+#define _callstackindex ctx.callstackindex
+#define _forstackindex ctx.forstackindex
+#define _e_set ctx.e_set
+#define _e_set_t ctx.e_set_t
+#define _e_val ctx.e_val
+#define _ri0 ctx.ri0
+#define _ri1 ctx.ri1
+#define _v ctx.v
+#define _flag ctx.flag
 
 #endif
\ No newline at end of file
@@ -4,6 +4,7 @@
 // some incude files for funcs, you need change to your device framework files
 /**********************************************************************/
 #include <LUFA/Drivers/Board/LEDs.h>
+#include <util/crc16.h>
 #include "Common.h"
 #include "HID.h"
 
@@ -27,6 +28,38 @@ void EasyCon_write_byte(uint8_t* addr,uint8_t value)
     eeprom_write_byte(addr,value);
 }
 
+/* whether a write can start without waiting for the previous one
+ * need implement
+ */
+bool EasyCon_eeprom_ready(void)
+{
+    return eeprom_is_ready();
+}
+
+/* EasyCon read a block from E2Prom or flash 
+ * need implement
+ */
+void EasyCon_read_block(uint8_t* dst,uint8_t* addr,uint16_t length)
+{
+    eeprom_read_block(dst,addr,length);
+}
+
+/* EasyCon write a block to E2Prom or flash 
+ * need implement
+ */
+void EasyCon_write_block(uint8_t* addr,const uint8_t* src,uint16_t length)
+{
+    eeprom_write_block(src,addr,length);
+}
+
+/* EasyCon write a block to E2Prom or flash, skipping bytes that already match 
+ * need implement
+ */
+void EasyCon_update_block(uint8_t* addr,const uint8_t* src,uint16_t length)
+{
+    eeprom_update_block(src,addr,length);
+}
+
 /* EasyCon read 2 byte from E2Prom or flash 
  * need implement
  */
@@ -69,14 +102,33 @@ void EasyCon_blink_led(void)
 }
 
 /* serial send 1 byte
- * need implement,block
+ * need implement,no block unless queue is full
  */
 void EasyCon_serial_send(const char DataByte)
 {
-    Serial_SendByte(DataByte);
+    Serial_QueueByte(DataByte);
     EasyCon_blink_led();
 }
 
+/* serial send a frame, not interleaved with other bytes
+ * need implement,no block, drop and return false if it doesn't fit
+ */
+bool EasyCon_serial_send_frame(const uint8_t *data, uint8_t length)
+{
+    if (!Serial_QueueFrame(data, length))
+        return false;
+    EasyCon_blink_led();
+    return true;
+}
+
+/* update CRC-16/CCITT (reflected 0x8408) with 1 byte
+ * need implement
+ */
+uint16_t EasyCon_crc16_update(uint16_t crc, uint8_t data)
+{
+    return _crc_ccitt_update(crc, data);
+}
+
 // about hid report
 
 /* reset hid report to default.
@@ -12,10 +12,16 @@
 #include "HID.h"
 
 /**********************************************************************/
-// EasyCon API, you need set the MEM_SIZE that could use in your SRAM and (EEPROM or Flash)
+// EasyCon API, you need set the MEM_SIZE of script in (EEPROM or Flash), and VM depths for your SRAM in binfos.h
 /**********************************************************************/
 // #define MEM_SIZE      924
 
+/* storage of constant data (embedded script), and how to read it back
+ * need define
+ */
+#define EASYCON_CONST PROGMEM
+#define EasyCon_read_const_byte(addr) pgm_read_byte(addr)
+
 /**********************************************************************/
 // EasyCon API, you need to call them in somewhere
 /**********************************************************************/
@@ -31,6 +37,36 @@ extern void EasyCon_tick(void);
  */
 extern void EasyCon_serial_task(int16_t byte);
 
+/* usb start of frame
+ * need call on every SOF
+ */
+extern void EasyCon_frame(void);
+
+/* whether a report should be sent now
+ * need check before sending a report
+ */
+extern bool EasyCon_report_due(void);
+
+/* record report changes while script is running
+ * need call when a report sent, with the report bytes
+ */
+extern void EasyCon_report_trace(const uint8_t *report);
+
+/* background EEPROM writer for staged script
+ * need call in main loop
+ */
+extern void EasyCon_stage_task(void);
+
+/* telemetry stream
+ * need call in main loop
+ */
+extern void EasyCon_telemetry_task(void);
+
+/* trace and lap replies, sent in pieces
+ * need call in main loop
+ */
+extern void EasyCon_dump_task(void);
+
 /* decrement
  * need call when a report sent
  * no date return -1
@@ -51,6 +87,26 @@ extern uint8_t EasyCon_read_byte(uint8_t* addr);
  */
 extern void EasyCon_write_byte(uint8_t* addr,uint8_t value);
 
+/* whether a write can start without waiting for the previous one
+ * need implement
+ */
+extern bool EasyCon_eeprom_ready(void);
+
+/* EasyCon read a block from E2Prom or flash 
+ * need implement
+ */
+extern void EasyCon_read_block(uint8_t* dst,uint8_t* addr,uint16_t length);
+
+/* EasyCon write a block to E2Prom or flash 
+ * need implement
+ */
+extern void EasyCon_write_block(uint8_t* addr,const uint8_t* src,uint16_t length);
+
+/* EasyCon write a block to E2Prom or flash, skipping bytes that already match 
+ * need implement
+ */
+extern void EasyCon_update_block(uint8_t* addr,const uint8_t* src,uint16_t length);
+
 /* EasyCon read 2 byte from E2Prom or flash 
  * need implement
  */
@@ -77,10 +133,20 @@ extern void EasyCon_runningLED_off(void);
 extern void EasyCon_blink_led(void);
 
 /* serial send 1 byte
- * need implement,block
+ * need implement,no block unless queue is full
  */
 extern void EasyCon_serial_send(const char DataByte);
 
+/* serial send a frame, not interleaved with other bytes
+ * need implement,no block, drop and return false if it doesn't fit
+ */
+extern bool EasyCon_serial_send_frame(const uint8_t *data, uint8_t length);
+
+/* update CRC-16/CCITT (reflected 0x8408) with 1 byte
+ * need implement
+ */
+extern uint16_t EasyCon_crc16_update(uint16_t crc, uint8_t data);
+
 // about hid report
 
 /* reset hid report to default.
@@ -98,6 +164,36 @@ extern void SetLeftStick(const uint8_t LX, const uint8_t LY);
  */
 extern void SetRightStick(const uint8_t RX, const uint8_t RY);
 
+/* set whole hid report at once.
+ * need implement
+ */
+extern void SetReport(const uint16_t Button, const uint8_t HAT, const uint8_t LX, const uint8_t LY, const uint8_t RX, const uint8_t RY);
+
+/* set host input merged into hid report when sent.
+ * need implement
+ */
+extern void SetOverlay(const uint16_t Button, const uint8_t HAT, const uint8_t LX, const uint8_t LY, const uint8_t RX, const uint8_t RY);
+
+/* remove host input from hid report.
+ * need implement
+ */
+extern void ClearOverlay(void);
+
+/* copy whole hid report.
+ * need implement
+ */
+extern void GetReport(uint8_t *Report);
+
+/* get left stick in hid report.
+ * need implement
+ */
+extern void GetLeftStick(uint8_t *LX, uint8_t *LY);
+
+/* get right stick in hid report.
+ * need implement
+ */
+extern void GetRightStick(uint8_t *RX, uint8_t *RY);
+
 /* set button in hid report.
  * need implement
  */
@@ -127,7 +223,11 @@ extern void EasyCon_script_task(void);
 extern void EasyCon_script_auto_start(void);
 extern bool EasyCon_is_script_running(void);
 extern void EasyCon_script_start(void);
+extern void EasyCon_script_request_start(void);
 extern void EasyCon_script_stop(void);
+extern bool EasyCon_script_select(uint8_t slot);
+extern void EasyCon_script_select_next(void);
+extern void EasyCon_script_request_select_next(void);
 
 volatile uint8_t echo_ms; // echo counter
 
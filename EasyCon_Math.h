@@ -0,0 +1,86 @@
+#ifndef _EASY_CON_MATH_H_
+#define _EASY_CON_MATH_H_
+
+#include <stdint.h>
+
+/**********************************************************************/
+// integer kernels for 8-bit MCU, avoiding software division
+/**********************************************************************/
+
+/* 16-bit xorshift, period 65535
+ * state must not be 0
+ */
+static inline uint16_t xorshift16(uint16_t *state)
+{
+    uint16_t x = *state;
+    x ^= x << 7;
+    x ^= x >> 9;
+    x ^= x << 8;
+    *state = x;
+    return x;
+}
+
+/* uniform random number in [0, range), range must not be 0
+ * masked rejection, less than 2 draws on average
+ */
+static inline uint16_t random_range(uint16_t *state, uint16_t range)
+{
+    uint16_t mask = range - 1;
+    uint16_t x;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    do
+        x = xorshift16(state) & mask;
+    while (x >= range);
+    return x;
+}
+
+/* same range as rand() % range
+ * negative range gives [0, -range), 0 gives [0, 0x7FFF]
+ */
+static inline int16_t random_mod(uint16_t *state, int16_t range)
+{
+    if (range == 0)
+        return xorshift16(state) & 0x7FFF;
+    return random_range(state, range < 0 ? (uint16_t)0 - (uint16_t)range : (uint16_t)range);
+}
+
+/* divisor is a positive power of two */
+static inline bool is_pow2(int16_t b)
+{
+    return b > 0 && (b & (b - 1)) == 0;
+}
+
+/* a / b for power of two b, truncating toward zero like C division
+ */
+static inline int16_t div_pow2(int16_t a, uint16_t b)
+{
+    if (a < 0)
+        a += b - 1;
+    if (b >= 256)
+    {
+        // whole byte at once
+        a >>= 8;
+        b >>= 8;
+    }
+    while (b > 1)
+    {
+        a >>= 1;
+        b >>= 1;
+    }
+    return a;
+}
+
+/* a % b for power of two b, with the sign of a like C remainder
+ */
+static inline int16_t mod_pow2(int16_t a, uint16_t b)
+{
+    int16_t r = a & (b - 1);
+    if (a < 0 && r != 0)
+        r -= b;
+    return r;
+}
+
+#endif
@@ -1,29 +1,90 @@
 #include "HID.h"
+#include <util/atomic.h>
+#ifdef EASYCON_BENCH
+#include "Bench.h"
+#endif
 
 USB_JoystickReport_Input_t next_report;
+// host input merged into script report when sent
+USB_JoystickReport_Input_t overlay_report = {0, HAT_CENTER, STICK_CENTER, STICK_CENTER, STICK_CENTER, STICK_CENTER, 0};
 
 
+// Reports are copied in the SOF interrupt (USB_INTERRUPT) or the main loop, sticks move from the timer
+// interrupt and the overlay is set from the serial interrupt, so each update is done with interrupts off.
+
 // Reset report to default.
 void ResetReport(void)
 {
-  memset(&next_report, 0, sizeof(USB_JoystickReport_Input_t));
-  next_report.LX = STICK_CENTER;
-  next_report.LY = STICK_CENTER;
-  next_report.RX = STICK_CENTER;
-  next_report.RY = STICK_CENTER;
-  next_report.HAT = HAT_CENTER;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    memset(&next_report, 0, sizeof(USB_JoystickReport_Input_t));
+    next_report.LX = STICK_CENTER;
+    next_report.LY = STICK_CENTER;
+    next_report.RX = STICK_CENTER;
+    next_report.RY = STICK_CENTER;
+    next_report.HAT = HAT_CENTER;
+  }
 }
-void SetButtons(const uint16_t Button) {next_report.Button = Button;}
-void PressButtons(const uint16_t Button) {next_report.Button |= Button;}
-void ReleaseButtons(const uint16_t Button) {next_report.Button &= ~(Button);}
+void SetButtons(const uint16_t Button) {ATOMIC_BLOCK(ATOMIC_RESTORESTATE) next_report.Button = Button;}
+void PressButtons(const uint16_t Button) {ATOMIC_BLOCK(ATOMIC_RESTORESTATE) next_report.Button |= Button;}
+void ReleaseButtons(const uint16_t Button) {ATOMIC_BLOCK(ATOMIC_RESTORESTATE) next_report.Button &= ~(Button);}
 void SetHATSwitch(const uint8_t HAT) {next_report.HAT = HAT;}
 void SetLeftStick(const uint8_t LX, const uint8_t LY)
 {
-  next_report.LX = LX; next_report.LY = LY;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    next_report.LX = LX; next_report.LY = LY;
+  }
 }
 void SetRightStick(const uint8_t RX, const uint8_t RY)
 {
-  next_report.RX = RX; next_report.RY = RY;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    next_report.RX = RX; next_report.RY = RY;
+  }
+}
+void SetReport(const uint16_t Button, const uint8_t HAT, const uint8_t LX, const uint8_t LY, const uint8_t RX, const uint8_t RY)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    next_report.Button = Button; next_report.HAT = HAT;
+    next_report.LX = LX; next_report.LY = LY;
+    next_report.RX = RX; next_report.RY = RY;
+  }
+}
+void SetOverlay(const uint16_t Button, const uint8_t HAT, const uint8_t LX, const uint8_t LY, const uint8_t RX, const uint8_t RY)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    overlay_report.Button = Button; overlay_report.HAT = HAT;
+    overlay_report.LX = LX; overlay_report.LY = LY;
+    overlay_report.RX = RX; overlay_report.RY = RY;
+  }
+}
+void ClearOverlay(void)
+{
+  SetOverlay(0, HAT_CENTER, STICK_CENTER, STICK_CENTER, STICK_CENTER, STICK_CENTER);
+}
+void GetReport(uint8_t *Report)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    memcpy(Report, &next_report, sizeof(USB_JoystickReport_Input_t));
+  }
+}
+void GetLeftStick(uint8_t *LX, uint8_t *LY)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    *LX = next_report.LX; *LY = next_report.LY;
+  }
+}
+void GetRightStick(uint8_t *RX, uint8_t *RY)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    *RX = next_report.RX; *RY = next_report.RY;
+  }
 }
 
 void HIDInit(void)
@@ -32,13 +93,27 @@ void HIDInit(void)
   USB_Init();
 }
 
-void Report_Task(void);
+bool Report_Task(void);
+static inline void Report_Service(void)
+{
+#ifdef EASYCON_BENCH
+  uint16_t cycles = Bench_Cycles();
+  bool sent = Report_Task();
+  Bench_Report(Bench_Cycles() - cycles, sent);
+#else
+  Report_Task();
+#endif
+}
+
 void HIDTask(void)
 {
+#if !defined(USB_INTERRUPT)
   // We need to run our task to process and deliver data for our IN and OUT endpoints.
-  Report_Task();
+  Report_Service();
   // We also need to run the main USB management task.
   USB_USBTask();
+#endif
+  // Otherwise control requests are handled by the USB_COM interrupt and reports on start of frame.
 }
 
 // Fired to indicate that the device is enumerating.
@@ -64,9 +139,22 @@ void EVENT_USB_Device_ConfigurationChanged(void)
   ConfigSuccess &= Endpoint_ConfigureEndpoint(JOYSTICK_OUT_EPADDR, EP_TYPE_INTERRUPT, JOYSTICK_EPSIZE, 1);
   ConfigSuccess &= Endpoint_ConfigureEndpoint(JOYSTICK_IN_EPADDR, EP_TYPE_INTERRUPT, JOYSTICK_EPSIZE, 1);
 
+  // Frames are counted for report scheduling and frame waits.
+  USB_Device_EnableSOFEvents();
+
   // We can read ConfigSuccess to indicate a success or failure at this point.
 }
 
+// Fired at the start of each USB frame, every 1 ms.
+void EVENT_USB_Device_StartOfFrame(void)
+{
+  EasyCon_frame();
+#if defined(USB_INTERRUPT)
+  // Fill the IN endpoint before the host polls in this frame, whatever the script is doing.
+  Report_Service();
+#endif
+}
+
 // Process control requests sent to the device from the USB host.
 void EVENT_USB_Device_ControlRequest(void)
 {
@@ -95,15 +183,44 @@ void EVENT_USB_Device_ControlRequest(void)
 // Prepare the next report for the host.
 inline void GetNextReport(USB_JoystickReport_Input_t *const ReportData)
 {
-	memcpy(ReportData, &next_report, sizeof(USB_JoystickReport_Input_t));
+	USB_JoystickReport_Input_t overlay;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		memcpy(ReportData, &next_report, sizeof(USB_JoystickReport_Input_t));
+		memcpy(&overlay, &overlay_report, sizeof(USB_JoystickReport_Input_t));
+	}
+	// buttons are combined, HAT and each stick of the overlay win when off center
+	ReportData->Button |= overlay.Button;
+	if (overlay.HAT != HAT_CENTER)
+		ReportData->HAT = overlay.HAT;
+	if (overlay.LX != STICK_CENTER || overlay.LY != STICK_CENTER)
+	{
+		ReportData->LX = overlay.LX;
+		ReportData->LY = overlay.LY;
+	}
+	if (overlay.RX != STICK_CENTER || overlay.RY != STICK_CENTER)
+	{
+		ReportData->RX = overlay.RX;
+		ReportData->RY = overlay.RY;
+	}
 }
 
-// Process and deliver data from IN and OUT endpoints.
-void Report_Task(void)
+// Process and deliver data from IN and OUT endpoints, return whether a report was sent.
+bool Report_Task(void)
 {
+  bool Sent = false;
+#if defined(USB_INTERRUPT)
+  uint8_t PrevEndpoint;
+#endif
+
   // If the device isn't connected and properly configured, we can't do anything here.
   if (USB_DeviceState != DEVICE_STATE_Configured)
-    return;
+    return false;
+
+#if defined(USB_INTERRUPT)
+  // We may have interrupted the control endpoint being serviced, it gets selected again when we're done.
+  PrevEndpoint = Endpoint_GetCurrentEndpoint();
+#endif
 
   // We'll start with the OUT endpoint.
   Endpoint_SelectEndpoint(JOYSTICK_OUT_EPADDR);
@@ -126,7 +243,7 @@ void Report_Task(void)
   }
 
 // [Optimized] Only send data when changed.
-  if (echo_ms == 0)
+  if (EasyCon_report_due())
   {
 //////////////////////////////////////////
     // We'll then move on to the IN endpoint.
@@ -150,12 +267,17 @@ void Report_Task(void)
         // We then send an IN packet on this endpoint.
         Endpoint_ClearIN();
 
+        EasyCon_report_trace((const uint8_t *)&JoystickInputData);
+        // count down echoes and set interval
         Echo_Report();
-        // set interval
-        echo_ms = ECHO_INTERVAL;
+        Sent = true;
       }
     }
 // echo_ms end
   }
 ////////////////////////////////////////////
+#if defined(USB_INTERRUPT)
+  Endpoint_SelectEndpoint(PrevEndpoint);
+#endif
+  return Sent;
 }
\ No newline at end of file
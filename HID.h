@@ -76,6 +76,7 @@ void EVENT_USB_Device_Connect(void);
 void EVENT_USB_Device_Disconnect(void);
 void EVENT_USB_Device_ConfigurationChanged(void);
 void EVENT_USB_Device_ControlRequest(void);
+void EVENT_USB_Device_StartOfFrame(void);
 
 void ResetReport(void);
 void SetButtons(const uint16_t Button);
@@ -84,3 +85,9 @@ void ReleaseButtons(const uint16_t Button);
 void SetHATSwitch(const uint8_t HAT);
 void SetLeftStick(const uint8_t LX, const uint8_t LY);
 void SetRightStick(const uint8_t RX, const uint8_t RY);
+void SetReport(const uint16_t Button, const uint8_t HAT, const uint8_t LX, const uint8_t LY, const uint8_t RX, const uint8_t RY);
+void SetOverlay(const uint16_t Button, const uint8_t HAT, const uint8_t LX, const uint8_t LY, const uint8_t RX, const uint8_t RY);
+void ClearOverlay(void);
+void GetReport(uint8_t *Report);
+void GetLeftStick(uint8_t *LX, uint8_t *LY);
+void GetRightStick(uint8_t *RX, uint8_t *RY);
@@ -6,6 +6,10 @@
 #define reset_bit(r,b) ((r) &= ~(1u << (b)))
 #define set_bit(r,b) ((r) |= (1u << (b)))
 
+// PB5 button timing, in ms
+#define BUTTON_DEBOUNCE_MS 20
+#define BUTTON_LONG_PRESS_MS 1000
+
 static inline void PCIInit(void)
 {
     // pinMode(PB0, INPUT_PULLUP);
@@ -19,21 +19,30 @@ these buttons for our use.
 */
 
 #include "Joystick.h"
+#ifdef EASYCON_BENCH
+#include "Bench.h"
+#endif
+
+static volatile bool button_down = false; // PB5 is held
+static volatile uint16_t button_ms = 0;   // how long PB5 has been held
 
 int main(void)
 {
     SystemInit();
     CommonInit();
     PCIInit();
-    // Initialize script.
+    // Initialize script, installing the embedded one may write EEPROM for a while.
     EasyCon_script_init();
-    // The USB stack should be initialized last.
+    // The USB stack should be initialized last, nothing services it before the main loop.
     HIDInit();
     // Once that's done, we'll enter an infinite loop.
     while (1)
     {
         // Process local script instructions.
         EasyCon_script_task();
+        EasyCon_stage_task();
+        EasyCon_telemetry_task();
+        EasyCon_dump_task();
         HIDTask();
     }
 }
@@ -45,12 +54,29 @@ ISR(TIMER0_OVF_vect) // timer0 overflow interrupt ~1ms
     // script ms
     EasyCon_tick();
 
+    if (button_down && button_ms != 0xFFFF)
+        button_ms++;
+
     BlinkLEDTick();
+#ifdef EASYCON_BENCH
+    Bench_Tick();
+#endif
 }
 
 ISR(USART1_RX_vect)
 {
+#ifdef EASYCON_BENCH
+    uint16_t cycles = Bench_Cycles();
+    EasyCon_serial_task(Serial_ReceiveByte());
+    Bench_Serial(Bench_Cycles() - cycles);
+#else
     EasyCon_serial_task(Serial_ReceiveByte());
+#endif
+}
+
+ISR(USART1_UDRE_vect)
+{
+    Serial_TXTask();
 }
 
 ISR(PCINT0_vect)
@@ -58,13 +84,30 @@ ISR(PCINT0_vect)
     /* This is where you get when an interrupt is happening */
     if(!read_bit(PINB, PB5))
     {
-        if(EasyCon_is_script_running())
+        // pressed, act on release
+        button_down = true;
+        button_ms = 0;
+    }
+    else if(button_down)
+    {
+        button_down = false;
+        if(button_ms < BUTTON_DEBOUNCE_MS)
+        {
+            // bounce
+        }
+        else if(button_ms >= BUTTON_LONG_PRESS_MS)
+        {
+            // long press, switch to next script slot
+            EasyCon_script_request_select_next();
+            EasyCon_blink_led();
+        }
+        else if(EasyCon_is_script_running())
         {
             EasyCon_script_stop();
         }
         else
         {
-            EasyCon_script_start();
+            EasyCon_script_request_start();
         }
     }
 }
\ No newline at end of file
@@ -8,6 +8,15 @@ inline void timer0_init(void)
     TIMSK0 |= _BV(TOIE0); // Initialize timer0 interrupt
 }
 
+#ifdef EASYCON_BENCH
+inline void timer1_init(void)
+{
+    // no prescaler, free running as cycle counter for benchmarks
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+}
+#endif
+
 void SystemInit(void)
 {
     // We need to disable watchdog if enabled by bootloader/fuses.
@@ -20,6 +29,9 @@ void SystemInit(void)
     GlobalInterruptDisable();
     // 8-bit TCNT0 max 255.
     timer0_init();
+#ifdef EASYCON_BENCH
+    timer1_init();
+#endif
     // We'll then enable global interrupts for our use.
     GlobalInterruptEnable();
 }
\ No newline at end of file
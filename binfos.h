@@ -1,9 +1,25 @@
 #ifndef BINFOS_H
 #define BINFOS_H
 
+// MEM_SIZE is the script capacity, both in EEPROM and embedded in firmware.
+// SCRIPT_IMAGES is how many script images of MEM_SIZE fit in EEPROM.
+// VM stack depths and script cache are sized by the SRAM of each board.
+
 #ifdef UNO
      #define MEM_SIZE 398
      #define LED_TX   LEDS_LED2
+     // atmega16u2, 512 bytes SRAM
+     #define STACK_DEPTH       8
+     #define CALLSTACK_DEPTH   8
+     #define FORSTACK_DEPTH    6
+     #define SCRIPT_CACHE_SIZE 0
+     // 16 KB flash, stick motion instructions are skipped
+     #define STICK_MOTION      0
+     #define COMPRESSED_SCRIPT 0
+     #define REPORT_TRACE_LENGTH 0
+     #define SERIAL_TX_SIZE    32
+     #define EXEC_TRACE_LENGTH 0
+     #define LAP_LOG_LENGTH    0
 #endif
 
 #ifdef Beetle
@@ -21,12 +37,85 @@
 
 #ifdef Teensy2pp
      #define LED_TX   LEDS_LED1
+     // at90usb1286, 8 KB SRAM, whole script cached
+     #define STACK_DEPTH       64
+     #define CALLSTACK_DEPTH   64
+     #define FORSTACK_DEPTH    24
+     #define SCRIPT_CACHE_SIZE MEM_SIZE
+     // 4 KB EEPROM
+     #define SCRIPT_IMAGES     4
+     #define REPORT_TRACE_LENGTH 128
+     #define SERIAL_TX_SIZE    128
+     #define EXEC_TRACE_LENGTH 256
+     #define EXEC_TRACE_REPORTS 16
+     #define LAP_LOG_LENGTH    64
+     // images are paired for A/B update
+     #define STAGE_BUFFER_SIZE 64
 #endif
 
 #if !defined(MEM_SIZE)
     #define MEM_SIZE      924
 #endif
 
+// atmega32u4, 2.5 KB SRAM
+#if !defined(STACK_DEPTH)
+    #define STACK_DEPTH       32
+#endif
+
+#if !defined(CALLSTACK_DEPTH)
+    #define CALLSTACK_DEPTH   32
+#endif
+
+#if !defined(FORSTACK_DEPTH)
+    #define FORSTACK_DEPTH    12
+#endif
+
+#if !defined(SCRIPT_CACHE_SIZE)
+    #define SCRIPT_CACHE_SIZE 256
+#endif
+
+#if !defined(STICK_MOTION)
+    #define STICK_MOTION      1
+#endif
+
+// compressed script images, decoded a block at a time while running
+#if !defined(COMPRESSED_SCRIPT)
+    #define COMPRESSED_SCRIPT 1
+#endif
+
+// report changes recorded per script run, for timing comparison on PC
+#if !defined(REPORT_TRACE_LENGTH)
+    #define REPORT_TRACE_LENGTH 32
+#endif
+
+// last executed instructions and report changes kept for post-mortem, power of two, 0 for off
+#if !defined(EXEC_TRACE_LENGTH)
+    #define EXEC_TRACE_LENGTH 64
+#endif
+
+#if !defined(EXEC_TRACE_REPORTS)
+    #define EXEC_TRACE_REPORTS 4
+#endif
+
+// newest Lap markers kept per script run, power of two, 0 for off
+#if !defined(LAP_LOG_LENGTH)
+    #define LAP_LOG_LENGTH    16
+#endif
+
+// chunk size for flashing the inactive image while running, only with 2 or more images
+#if !defined(STAGE_BUFFER_SIZE)
+    #define STAGE_BUFFER_SIZE 0
+#endif
+
+// serial transmit queue, power of two
+#if !defined(SERIAL_TX_SIZE)
+    #define SERIAL_TX_SIZE    64
+#endif
+
+#if !defined(SCRIPT_IMAGES)
+    #define SCRIPT_IMAGES     1
+#endif
+
 #if !defined(LED_TX)
     #define LED_TX      LEDS_LED2
 #endif
@@ -1,14 +1,17 @@
 ifeq ($(REAL_BOARD),UNO)
   MCU		  = atmega16u2
+  SRAM_SIZE	  = 512
   #REALBOARD1 = UNO 
 endif
 ifeq  ($(REAL_BOARD),Teensy2pp)
   MCU		  = at90usb1286
+  SRAM_SIZE	  = 8192
   #REALBOARD1 = Teensy2pp
 endif
 
 #REALBOARD1  ?= Leonardo
 MCU          ?= atmega32u4
+SRAM_SIZE    ?= 2560
 ARCH         = AVR8
 F_CPU        = 16000000
 F_USB        = $(F_CPU)
@@ -18,6 +21,7 @@ SRC          += Joystick.c LUFADescriptors.c
 SRC		 	 += HID.c System.c Common.c
 SRC		 	 += EasyCon_API.c
 SRC		 	 += EasyCon.c
+SRC		 	 += Bench.c
 SRC			 += $(LUFA_SRC_USB)
 CC_FLAGS     = -DUSE_LUFA_CONFIG_HEADER -IConfig -D$(REAL_BOARD)
 LD_FLAGS     =
@@ -30,6 +34,12 @@ mkdir:
 
 all:mkdir
 
+# Report SRAM left for the stack after static allocation
+.PHONY: headroom
+all: headroom
+headroom: $(TARGET).elf
+	@avr-size -A $< | awk '/^\.(data|bss|noinit) / {used += $$2} END {printf " [HEADROOM]: %s SRAM %d of %d bytes used, %d bytes free\n", "$(REAL_BOARD)", used, $(SRAM_SIZE), $(SRAM_SIZE) - used}'
+
 # Include LUFA build script makefiles
 LUFA_PATH    = ./lufa/LUFA
 include $(LUFA_PATH)/Build/lufa_core.mk
@@ -41,4 +51,12 @@ include $(LUFA_PATH)/Build/lufa_avrdude.mk
 
 # Target for LED/buzzer to alert when print is done
 with-alert: all
-with-alert: CC_FLAGS += -DALERT_WHEN_DONE
\ No newline at end of file
+with-alert: CC_FLAGS += -DALERT_WHEN_DONE
+
+# Target for USB serviced from interrupts, reports are sent on start of frame
+with-usb-interrupt: all
+with-usb-interrupt: CC_FLAGS += -DUSB_INTERRUPT
+
+# Target for on-device benchmarks over serial (CMD_BENCH)
+with-bench: all
+with-bench: CC_FLAGS += -DEASYCON_BENCH
\ No newline at end of file
@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""Reference encoder for compressed script images (COMPRESSED_SCRIPT in binfos.h).
+
+Input is a plain image as flashed: eof (2 bytes, little-endian) followed by code.
+Output is the compressed image, see EasyCon.h for the layout:
+
+    eof | COMPRESSED_FLAG, dictionary size, block index (2 bytes per block), dictionary, blocks
+
+Each BLOCK_SIZE logical bytes are encoded on their own, so a block decodes without the
+ones before it. A token may produce bytes past the end of its block, the firmware cuts
+them off; the next block then starts with its own tokens for those bytes. Blocks other
+than the last must fill their block. The last block is followed by a 0xFF byte, which
+reads as a dictionary entry past the dictionary and ends decoding, so the dictionary is
+kept below 128 entries.
+
+Every image written is decoded again the way script_decode_block does and compared with
+the input. Run with --check to encode the built-in vector and compare with known output.
+
+usage: compress_script.py [--check] [--size MEM_SIZE] input.bin output.bin
+"""
+
+import argparse
+import sys
+from collections import Counter
+
+COMPRESSED_FLAG = 0x4000
+BLOCK_SIZE = 64
+BLOCK_INDEX = 3
+DICT_ENTRY = 4
+DICT_MAX = 127
+TOKEN_REPEAT = 0x40
+TOKEN_ENTRY = 0x80
+REPEAT_MAX = 0x3F + 2
+LITERAL_MAX = 0x3F + 1  # words
+
+
+def pick_dictionary(logical, eof):
+    """Instruction pairs at even addresses that pay for their dictionary entry."""
+    counts = Counter(bytes(logical[p:p + DICT_ENTRY]) for p in range(2, eof - DICT_ENTRY + 1, 2))
+    return [pair for pair, n in counts.most_common(DICT_MAX) if n >= 2]
+
+
+def match(logical, p, end, pair):
+    """Whether pair produces the bytes at p, bytes at or past end are cut off."""
+    n = min(DICT_ENTRY, end - p)
+    return bytes(logical[p:p + n]) == pair[:n]
+
+
+def encode_block(logical, start, end, dictionary):
+    """Tokens for logical bytes start to end, end is the block end or eof of last block."""
+    out = bytearray()
+    literal = bytearray()
+
+    def flush():
+        nonlocal literal
+        while literal:
+            words = literal[:LITERAL_MAX * 2]
+            literal = literal[LITERAL_MAX * 2:]
+            out.append(len(words) // 2 - 1)
+            out.extend(words)
+
+    p = start
+    while p < end:
+        entry = next((i for i, pair in enumerate(dictionary) if match(logical, p, end, pair)), None)
+        if entry is None:
+            literal.extend(logical[p:p + 2])
+            p += 2
+            continue
+        flush()
+        count = 0
+        while p < end and count < REPEAT_MAX and match(logical, p, end, dictionary[entry]):
+            count += 1
+            p += DICT_ENTRY
+        if count == 1:
+            out.append(TOKEN_ENTRY | entry)
+        else:
+            out.extend((TOKEN_REPEAT | (count - 2), entry))
+    flush()
+    return out
+
+
+def compress(image):
+    """Compressed image of a plain one."""
+    eof = image[0] | (image[1] << 8)
+    if eof == 0xFFFF or eof & COMPRESSED_FLAG:
+        raise ValueError("input is empty or already compressed")
+    manual = eof & 0x8000
+    eof &= 0x7FFF
+    if eof < 2 or eof > len(image):
+        raise ValueError("eof %d outside image of %d bytes" % (eof, len(image)))
+    # odd tail is padded like erased EEPROM
+    logical = bytearray(image[:eof]) + b"\xff" * (eof & 1)
+    dictionary = pick_dictionary(logical, eof)
+    blocks = []
+    for start in range(0, eof, BLOCK_SIZE):
+        blocks.append(encode_block(logical, start, min(start + BLOCK_SIZE, eof), dictionary))
+    blocks[-1].append(0xFF)
+    header = bytearray((eof & 0xFF, (eof >> 8) | (manual >> 8) | (COMPRESSED_FLAG >> 8), len(dictionary)))
+    offset = BLOCK_INDEX + 2 * len(blocks) + DICT_ENTRY * len(dictionary)
+    for block in blocks:
+        header.extend((offset & 0xFF, offset >> 8))
+        offset += len(block)
+    for pair in dictionary:
+        header.extend(pair)
+    return bytes(header + b"".join(blocks))
+
+
+def decode_block(image, block, dict_size, dict_base):
+    """Window of one block, as script_decode_block fills it."""
+    src = image[BLOCK_INDEX + block * 2] | (image[BLOCK_INDEX + block * 2 + 1] << 8)
+    window = bytearray()
+
+    def read(addr):
+        return image[addr] if addr < len(image) else 0xFF
+
+    while len(window) < BLOCK_SIZE:
+        head = read(src)
+        src += 1
+        if head & (TOKEN_ENTRY | TOKEN_REPEAT) == 0:
+            length = min((head + 1) * 2, BLOCK_SIZE - len(window))
+            window.extend(read(src + i) for i in range(length))
+            src += length
+            continue
+        if head & TOKEN_ENTRY:
+            entry, count = head & 0x7F, 1
+        else:
+            entry, count = read(src), (head & 0x3F) + 2
+            src += 1
+        if entry >= dict_size:
+            break
+        for _ in range(count):
+            if len(window) == BLOCK_SIZE:
+                break
+            length = min(DICT_ENTRY, BLOCK_SIZE - len(window))
+            window.extend(image[dict_base + entry * DICT_ENTRY:dict_base + entry * DICT_ENTRY + length])
+    return window + b"\xff" * (BLOCK_SIZE - len(window))
+
+
+def decompress(image):
+    """Logical bytes up to eof, as the interpreter fetches them."""
+    eof = (image[0] | (image[1] << 8)) & ~COMPRESSED_FLAG & 0x7FFF
+    dict_size = image[2]
+    blocks = (eof + BLOCK_SIZE - 1) // BLOCK_SIZE
+    dict_base = BLOCK_INDEX + blocks * 2
+    logical = b"".join(decode_block(image, b, dict_size, dict_base) for b in range(blocks))
+    return logical[:eof]
+
+
+# Known-good vector, checked against the firmware decoder: Key A 100 ms / Wait 100 ms
+# pairs from address 2, so the repeated pair at 62 crosses the first block end and is
+# cut off there. The second block starts with the other half of that pair, then a Wait
+# and Return as literals.
+CHECK_PLAIN = bytes([0x5A, 0x00] + [0x84, 0x0A, 0x08, 0x0A] * 21 + [0x08, 0x64, 0x18, 0x00])
+CHECK_COMPRESSED = bytes([
+    0x5A, 0x40, 0x02,                                # eof 90 | COMPRESSED_FLAG, 2 dictionary entries
+    0x0F, 0x00, 0x14, 0x00,                          # block index
+    0x84, 0x0A, 0x08, 0x0A, 0x08, 0x0A, 0x84, 0x0A,  # dictionary
+    0x00, 0x5A, 0x00, 0x4E, 0x00,                    # block 0: 1 literal word, entry 0 x 16, last one cut off
+    0x43, 0x01, 0x02, 0x08, 0x0A, 0x08, 0x64, 0x18, 0x00,  # block 1: entry 1 x 5, 3 literal words
+    0xFF])                                           # end of last block
+
+
+def check():
+    if CHECK_PLAIN[:CHECK_PLAIN[0]] != CHECK_PLAIN:
+        raise AssertionError("vector eof does not match its length")
+    image = compress(CHECK_PLAIN)
+    if image != CHECK_COMPRESSED:
+        raise AssertionError("encoded vector differs:\n" + image.hex(" "))
+    if decompress(CHECK_COMPRESSED) != CHECK_PLAIN:
+        raise AssertionError("decoded vector differs")
+    print("check passed: %d bytes -> %d bytes" % (len(CHECK_PLAIN), len(CHECK_COMPRESSED)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compress a script image for COMPRESSED_SCRIPT boards.")
+    parser.add_argument("--check", action="store_true", help="verify the encoder against the built-in vector")
+    parser.add_argument("--size", type=int, help="image size of the board (MEM_SIZE), to reject images that don't fit")
+    parser.add_argument("input", nargs="?")
+    parser.add_argument("output", nargs="?")
+    args = parser.parse_args()
+    if args.check:
+        check()
+        return
+    if not args.input or not args.output:
+        parser.error("input and output are required")
+    with open(args.input, "rb") as f:
+        plain = f.read()
+    image = compress(plain)
+    eof = (plain[0] | (plain[1] << 8)) & 0x7FFF
+    if decompress(image) != bytes(plain[:eof]):
+        sys.exit("decoded image differs from input")
+    if args.size is not None and len(image) > args.size:
+        sys.exit("compressed image of %d bytes does not fit in %d" % (len(image), args.size))
+    with open(args.output, "wb") as f:
+        f.write(image)
+    print("%d bytes -> %d bytes%s" % (eof, len(image), "" if len(image) < eof else ", flash the plain image instead"))
+
+
+if __name__ == "__main__":
+    main()